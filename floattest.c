@@ -0,0 +1,83 @@
+/**
+ * @file
+ * @brief Checks that floats set with storage_set() come back from
+ * storage_get(), whatever their digits, sign or exponent.
+ *
+ * Run against a server whose config has a table taking the given value
+ * followed by a float column, e.g.
+ * "./floattest localhost 1111 marks 'name bob, mark 5' grade".  Exits with
+ * 0 if all checks pass.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "storage.h"
+#include "utils.h"
+
+#define SERVERUSERNAME "admin"
+#define SERVERPASSWORD "dog4sale"
+
+FILE *fileptr;//Global file pointer variable
+
+static const char *floats[] = {
+  "2.5", "2.75", "10.5", "12.5", "50.5", "99.9", "100.5", "12345.25",
+  "7", "10", "0", "0.5", "-2", "-12.25", "1e3", "1.5e-3"
+};
+
+int main(int argc, char *argv[]) {
+  char key[MAX_KEY_LEN];
+  char column[MAX_COLNAME_LEN + 2];
+  struct storage_record r;
+  void *conn;
+  const char *found;
+  float sent, got;
+  int failures = 0;
+  int i;
+  int n = sizeof floats / sizeof floats[0];
+
+  if(argc != 6){
+    printf("usage: %s <host> <port> <table> <value> <float column>\n", argv[0]);
+    return 1;
+  }
+  conn = storage_connect(argv[1], atoi(argv[2]));
+  if(conn == NULL || storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn) != 0){
+    printf("cannot connect or authenticate. Error code: %d.\n", errno);
+    return 1;
+  }
+  snprintf(column, sizeof column, "%s ", argv[5]);
+  for(i = 0; i < n; i++){
+    sprintf(key, "float%02d", i);
+    snprintf(r.value, sizeof r.value, "%s, %s %s", argv[4], argv[5], floats[i]);
+    memset(r.metadata, 0, sizeof r.metadata);
+    if(storage_set(argv[3], key, &r, conn) != 0){
+      printf("storage_set %s failed. Error code: %d.\n", floats[i], errno);
+      failures++;
+      continue;
+    }
+    memset(&r, 0, sizeof r);
+    if(storage_get(argv[3], key, &r, conn) != 0){
+      printf("storage_get %s failed. Error code: %d.\n", floats[i], errno);
+      failures++;
+      continue;
+    }
+    //the server prints floats back at full precision, so compare the numbers
+    found = strstr(r.value, column);
+    sent = strtof(floats[i], NULL);
+    got = found != NULL ? strtof(found + strlen(column), NULL) : NAN;
+    if(found == NULL || fabsf(got - sent) > 1e-6f * fabsf(sent)){
+      printf("%s came back as \"%s\"\n", floats[i], r.value);
+      failures++;
+    }
+  }
+
+  for(i = 0; i < n; i++){
+    sprintf(key, "float%02d", i);
+    storage_set(argv[3], key, NULL, conn);
+  }
+  storage_disconnect(conn);
+  printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+  return failures == 0 ? 0 : 1;
+}
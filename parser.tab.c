@@ -77,6 +77,9 @@
 
 	void deblank(char* input);
 	void scan_string(const char* str);
+	typedef struct yy_buffer_state *YY_BUFFER_STATE;
+	YY_BUFFER_STATE yy_scan_string(const char *str);
+	void yy_switch_to_buffer(YY_BUFFER_STATE new_buffer);
 	void yyerror (struct config_params *param, struct storage_record *record, struct bigstring *str, int* max_keys, char keynames[][100], int* status, char const *s);
 	int tot_key = 0;
 	int table_num = 0;
@@ -1573,7 +1576,12 @@ yyreduce:
 /* Line 1806 of yacc.c  */
 #line 85 "parser.y"
     {
-	 						  strncpy(param->tablelist[table_num], (yyvsp[(2) - (3)].name), sizeof(param->password));
+	 						  if (config_reserve(param, table_num, 0) != 0)
+	 						  {
+	 						      yyerror(param, record, str, max_keys, keynames, status, "too many tables");
+	 						      return -1;
+	 						  }
+	 						  strncpy(param->tablelist[table_num], (yyvsp[(2) - (3)].name), sizeof(param->tablelist[table_num]));
 	 						  param->num_columns[table_num] = column_num;
 	 						  table_num++;
 	 						  column_num = 0;
@@ -2086,6 +2094,11 @@ yyreduce:
 /* Line 1806 of yacc.c  */
 #line 393 "parser.y"
     {
+							  if (config_reserve(param, table_num, column_num) != 0)
+							  {
+							      yyerror(param, record, str, max_keys, keynames, status, "too many tables or columns");
+							      return -1;
+							  }
 							  (param->columnlist[table_num][column_num]).flag = 0;
 							  strncpy((param->columnlist[table_num][column_num]).typename, (yyvsp[(1) - (3)].name), sizeof((param->columnlist[table_num][column_num]).typename)); 
 							  column_num++;
@@ -2097,6 +2110,11 @@ yyreduce:
 /* Line 1806 of yacc.c  */
 #line 398 "parser.y"
     {
+							  if (config_reserve(param, table_num, column_num) != 0)
+							  {
+							      yyerror(param, record, str, max_keys, keynames, status, "too many tables or columns");
+							      return -1;
+							  }
 							  (param->columnlist[table_num][column_num]).flag = 0;
 							  strncpy((param->columnlist[table_num][column_num]).typename, (yyvsp[(1) - (3)].keyname), sizeof((param->columnlist[table_num][column_num]).typename)); 
 							  column_num++;	  
@@ -2113,9 +2131,15 @@ yyreduce:
 		  													      yyerror(param, record, str, max_keys, keynames, status, "negtive size of char array");
 		  													      return -1;
 		  												      }
+		  													  if (config_reserve(param, table_num, column_num) != 0)
+		  													  {
+		  													      yyerror(param, record, str, max_keys, keynames, status, "too many tables or columns");
+		  													      return -1;
+		  													  }
 		  													  
 		  													  (param->columnlist[table_num][column_num]).flag = 1;
 		  													  strncpy((param->columnlist[table_num][column_num]).typename, (yyvsp[(1) - (6)].name), sizeof((param->columnlist[table_num][column_num]).typename));
+		  													  (param->columnlist[table_num][column_num]).size = (yyvsp[(5) - (6)].port);
 		  													  column_num++;
 	  													}
     break;
@@ -2130,9 +2154,15 @@ yyreduce:
 		  													      yyerror(param, record, str, max_keys, keynames, status, "negtive size of char array");
 		  													      return -1;
 		  												      }
+		  													  if (config_reserve(param, table_num, column_num) != 0)
+		  													  {
+		  													      yyerror(param, record, str, max_keys, keynames, status, "too many tables or columns");
+		  													      return -1;
+		  													  }
 		  													  
 		  													  (param->columnlist[table_num][column_num]).flag = 1;
 		  													  strncpy((param->columnlist[table_num][column_num]).typename, (yyvsp[(1) - (6)].keyname), sizeof((param->columnlist[table_num][column_num]).typename));
+		  													  (param->columnlist[table_num][column_num]).size = (yyvsp[(5) - (6)].port);
 		  													  column_num++;	  		
 	  													  }
     break;
@@ -0,0 +1,105 @@
+/**
+ * @file
+ * @brief Checks that storage_range() and storage_prefix() return every
+ * key of a scan longer than one server reply.
+ *
+ * Run against a server whose config has a table taking the given value,
+ * e.g. "./scantest localhost 1111 marks 'name bob, mark 5'".  Exits with
+ * 0 if all checks pass.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "storage.h"
+#include "utils.h"
+
+#define SERVERUSERNAME "admin"
+#define SERVERPASSWORD "dog4sale"
+#define NUMKEYS 200 //several reply pages of keys
+#define MAXKEYS 500
+
+FILE *fileptr;//Global file pointer variable
+
+//Checks that keys[0..n) are "scan<first>" up to "scan<first + n - 1>"
+static int check_keys(char **keys, int n, int first, const char *what)
+{
+  char expected[MAX_KEY_LEN];
+  int i;
+  for(i = 0; i < n; i++){
+    sprintf(expected, "scan%03d", first + i);
+    if(strcmp(keys[i], expected) != 0){
+      printf("%s: key %d is \"%s\", expected \"%s\"\n", what, i, keys[i], expected);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  char key[MAX_KEY_LEN];
+  char **keys;
+  struct storage_record r;
+  void *conn;
+  int failures = 0;
+  int i, n;
+
+  if(argc != 5){
+    printf("usage: %s <host> <port> <table> <value>\n", argv[0]);
+    return 1;
+  }
+  conn = storage_connect(argv[1], atoi(argv[2]));
+  if(conn == NULL || storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn) != 0){
+    printf("cannot connect or authenticate. Error code: %d.\n", errno);
+    return 1;
+  }
+  keys = malloc(MAXKEYS * sizeof(char *));
+  for(i = 0; i < MAXKEYS; i++){
+    keys[i] = calloc(1, MAX_KEY_LEN + 1);
+  }
+  strncpy(r.value, argv[4], sizeof r.value);
+  r.value[sizeof r.value - 1] = '\0';
+  for(i = 0; i < NUMKEYS; i++){
+    sprintf(key, "scan%03d", i);
+    memset(r.metadata, 0, sizeof r.metadata);
+    if(storage_set(argv[3], key, &r, conn) != 0){
+      printf("storage_set %s failed. Error code: %d.\n", key, errno);
+      return 1;
+    }
+  }
+
+  //every key, in more pages than one reply holds
+  for(i = 0; i < MAXKEYS; i++){
+    strcpy(keys[i], "stale");
+  }
+  n = storage_range(argv[3], "scan000", "scan999", keys, MAXKEYS, conn);
+  printf("range of all: %d keys\n", n);
+  failures += n != NUMKEYS || check_keys(keys, n, 0, "range of all") || strcmp(keys[n], "stale") != 0;
+
+  //cut by max_keys inside a later page
+  n = storage_range(argv[3], "scan010", "", keys, 150, conn);
+  printf("range of 150: %d keys\n", n);
+  failures += n != 150 || check_keys(keys, n, 10, "range of 150");
+
+  //cut by last inside a later page
+  n = storage_range(argv[3], "scan020", "scan129", keys, MAXKEYS, conn);
+  printf("range 020-129: %d keys\n", n);
+  failures += n != 110 || check_keys(keys, n, 20, "range 020-129");
+
+  //a prefix spanning pages, stopping where the prefix ends
+  n = storage_prefix(argv[3], "scan1", keys, MAXKEYS, conn);
+  printf("prefix scan1: %d keys\n", n);
+  failures += n != 100 || check_keys(keys, n, 100, "prefix scan1");
+
+  n = storage_range(argv[3], "scan000", "scan999", keys, 0, conn);
+  failures += n != 0;
+
+  for(i = 0; i < NUMKEYS; i++){
+    sprintf(key, "scan%03d", i);
+    storage_set(argv[3], key, NULL, conn);
+  }
+  storage_disconnect(conn);
+  printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+  return failures == 0 ? 0 : 1;
+}
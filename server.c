@@ -24,7 +24,6 @@
 #include "utils.h"
 #include "storage.h"
 
-extern FILE *yyin;
 unsigned int botRT, topRT;
 ThreadInfo runtimeThreads[MAX_CONNECTIONS];
 
@@ -66,7 +65,7 @@ int flag = 0;
 // <prevcolumn>!<nextcolumn>
 // '?' signifies the end of input
 /*** End of Protocol Prototype ***/
-int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params, struct city **headlist, int *auth_success)
+int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params, struct citytable *tables, int *auth_success, struct querycursor *cursors)
 {
     int counter;
     char commandname[MAXLEN];//also used for return:command
@@ -82,6 +81,7 @@ int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params
     int tempcmd = 1;
     int tempcommand = 0;
     int i = 0;//common-purpose counter
+    memset(retline, 0, sizeof(retline));//replies are sent whole, no stack garbage
     printf("command received: %s\n", cmd);
     while(cmd[tempcmd] != '&'){
 	if(cmd[tempcmd] != '&'){
@@ -109,7 +109,9 @@ int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params
     }
     valuename[tempcommand] = '\0';
     tempcommand = 0;
-    if(strcmp(commandname, "QUERY") == 0){
+    if(strcmp(commandname, "QUERY") == 0 || strcmp(commandname, "SCAN") == 0 || strcmp(commandname, "STATS") == 0
+       || strcmp(commandname, "OPEN") == 0 || strcmp(commandname, "FETCH") == 0 || strcmp(commandname, "CLOSE") == 0
+       || strcmp(commandname, "AGGR") == 0 || strcmp(commandname, "EXPLAIN") == 0 || strcmp(commandname, "COUNT") == 0){
 	printf("command is: %s\n", commandname);
 	printf("table is: %s\n", tablename);
 	printf("valuename: %s\n", valuename);
@@ -141,7 +143,14 @@ int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params
 	printf("Processing line \"%s\"\n", cmd);
     }
     
+    //readers run without setMutex and pin what they can see until they exit
+    int ebr_slot = -1;
+    if (strcmp(commandname, "SET") != 0){
+	ebr_slot = ebr_enter();
+    }
+    
     if (strcmp(commandname, "SET") == 0){
+	int evicted = 0;
 	
     	pthread_mutex_lock( &setMutex );
     	
@@ -159,11 +168,11 @@ int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params
 	    sendall(sock, retline, sizeof(retline));
 	}
 	else {
-	    index = find_index(params->tablelist, tablename);
+	    index = find_index(params, tablename);
 	    if(index != -1){
 		//name found
-		struct city *head = headlist[index];
-		struct city *temp = find_city(head, keyname);
+		struct citytable *table = &tables[index];
+		struct city *temp = find_city(table, keyname);
 		printf("valuename: %s\n", valuename);
 		if(temp == NULL){
 		    //entry doesn't exist
@@ -178,13 +187,23 @@ int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params
 			encode_line(commandname, tablename, valuename, retline);
 			sendall(sock, retline, sizeof(retline));
 		    }
+		    else if(params->max_records > 0 && table->order.length >= params->max_records){
+			//table is at its record quota
+			cleanstring(tablename);
+			cleanstring(valuename);
+			sprintf(tablename, "FAIL");
+			sprintf(valuename, "QUOTA");
+			encode_line(commandname, tablename, valuename, retline);
+			sendall(sock, retline, sizeof(retline));
+		    }
 		    else{
 			int column_count = 0;
 			column_count = count_column(valuename);		
-			if (params->num_columns[index] == column_count)
+			if (params->num_columns[index] == column_count
+			    && (temp = insert_city(table, keyname, valuename)) != NULL)
 			    {
-				insert_city(headlist[index], keyname, valuename);
 				//VALUE IS INSERTED AS A STRING
+				evicted = evict_cities(params, tables, index, temp);
 				cleanstring(tablename);
 				cleanstring(valuename);
 				sprintf(tablename, "SUCCESS");
@@ -194,7 +213,7 @@ int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params
 			    }
 			else
 			    {
-				sprintf(retline, "SET FAIL COLUMN\n");
+				sprintf(retline, "SET FAIL COLUMN");
 				sendall(sock, retline, sizeof(retline));						
 			    }
 		    }
@@ -204,7 +223,7 @@ int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params
 		    if(strcmp(valuename, "@NULL@?") == 0){
 			//delete
 			//printf("delete entry\n");
-			delete_city(&head, keyname);
+			delete_city(table, keyname);
 			temp = NULL;
 			//sprintf(success, "SET$SUCCESS");
 			//sendall(sock, success, sizeof(success));
@@ -224,12 +243,12 @@ int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params
 			if (counter == temp->counter || counter == 0)
 			    {
 				int column_count = 0;
-				temp = find_city(headlist[index], keyname);
 				column_count = count_column(valuename);
 				
-				if (temp->numocolumns == column_count)
+				if (table->schema.numcolumns == column_count
+				    && (temp = modify_city(table, keyname, valuename)) != NULL)
 				    {
-					modify_city(temp, valuename);
+					evicted = evict_cities(params, tables, index, temp);
 					cleanstring(tablename);
 					cleanstring(valuename);
 					sprintf(tablename, "SUCCESS");
@@ -239,7 +258,7 @@ int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params
 				    }
 				else
 				    {
-					sprintf(retline, "SET FAIL COLUMN\n");
+					sprintf(retline, "SET FAIL COLUMN");
 					sendall(sock, retline, sizeof(retline));						
 				    }
 			    }
@@ -265,7 +284,11 @@ int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params
 	    }
 	}
 	
+	ebr_collect();//free what no reader can still hold
 	pthread_mutex_unlock( &setMutex );
+	if(evicted > 0 && LOGGING==1){
+	    printf("evicted %d records\n", evicted);//once per SET, outside setMutex
+	}
     }
     
     // For now, just send back the command to the client.
@@ -323,15 +346,12 @@ int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params
 	    //sendall(sock, success, sizeof(success));
 	}
 	printf("tablename: %s\n", tablename);
-	index=find_index(params->tablelist, tablename);
+	index=find_index(params, tablename);
 	printf("index: %d\n", index);
 	if(index != -1) {
 	    //name found
-	    struct city *head = (headlist)[index];
-	    print_city(head);
-	    struct city *temp = find_city(head, keyname);
+	    struct city *temp = find_city(&tables[index], keyname);
 	    //printf("temp key: %s\n", temp->name);
-	    //printf("temp colnum: %d\n", temp->numocolumns);
 	    if(temp == NULL){
 		//key doesn't exist
 		//strncpy(fail, "GET$KEY$FAIL$FAIL", sizeof(fail));
@@ -348,11 +368,9 @@ int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params
 	    }
 	    else {
 		//key exists
-		//printf("columnlist: %s\n", temp->columnlist);
 		//printf("encoded_value: %s\n", encoded_value);
-		//printf("temp->numocolumns: %d\n", temp->numocolumns);
 		cleanstring(encoded_value);
-		encode_retval(temp->columnlist, encoded_value, temp->numocolumns);
+		encode_retval(&tables[index], temp->row, encoded_value);
 		cleanstring(tablename);
 		cleanstring(valuename);
 		sprintf(tablename, "SUCCESS");
@@ -392,45 +410,63 @@ int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params
 	//then do searching
 	//when done, encode the keylist and send back to client
 	puts("$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$HANDLEQUERY$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$");
-	struct queryarg *testque = (struct queryarg *)malloc(sizeof(struct queryarg));
+	struct queryarg *testque = (struct queryarg *)calloc(1, sizeof(struct queryarg));
+	struct queryprog queprog;
 	int numque = 0;
 	int questatus = 0;
-	char server_keylist[1000][1024];
-	for(i = 0; i < 1000; i++){
-	    cleanstring(server_keylist[i]);
-	}
-	strncpy(server_keylist[0], "testcopy", sizeof(server_keylist[0]));
-	index = find_index(params->tablelist, tablename);
+	struct keylist server_keylist;
+	keylist_init(&server_keylist);
+	index = (*auth_success) == 0 ? -1 : find_index(params, tablename);
 	//printf("index is %d\n", index);
 	if(index != -1){
 	    //found matching name in tablelist
-	    struct city *node = (headlist)[index];
 	    numque = query_argument(testque, valuename);
 	    //printf("numque = %d\n", numque);
-	    testque->max_keys++;
-	    questatus = query_write(server_keylist, testque, node, &testque->max_keys, &numque);
+	    questatus = query_compile(&queprog, testque, numque, &tables[index]);
+	    if(questatus == 0){
+		int limit = queprog.limit >= 0 && queprog.limit < testque->max_keys ? queprog.limit : testque->max_keys;
+		int lastvalue = 0;
+		unsigned int lastslot = 0;
+		if(limit > CURSOR_PAGE){
+		    limit = CURSOR_PAGE;//all one reply line holds
+		}
+		if(queprog.order >= 0){
+		    if(query_top(&server_keylist, NULL, &queprog, &tables[index], false, &lastvalue, &lastslot, limit) == -1){
+			questatus = -2;
+		    }
+		}
+		else {
+		    questatus = query_write(&server_keylist, &queprog, &tables[index], limit);
+		}
+	    }
 	    if(questatus == -1) {
-		//printf("query incorrect\n");
+		//unknown column or mismatched type
+		cleanstring(retline);
+		sprintf(retline, "&QUERY&$FAIL$^INVALID^");
+		sendall(sock, retline, sizeof(retline));
+	    }
+	    else if(questatus == -2) {
+		cleanstring(retline);
+		sprintf(retline, "&QUERY&$FAIL$^MEMORY^");
+		sendall(sock, retline, sizeof(retline));
 	    }
 	    else if(questatus == 0) {
 		//printf("query correct\n");
-		i = 1;
-		if(server_keylist[i][0] == '\0') {
+		if(server_keylist.count == 0) {
 		    printf("no matching keys detected.\n");
 		}
-		while(server_keylist[i][0] != '\0'){
-		    printf("keylist[%d]: %s\n", i, server_keylist[i]);
-		    i++;
-		}
-		if(i > testque->max_keys){
-		    i = testque->max_keys;
-		}
-		encode_queryret(i, server_keylist, retline);
+		encode_queryret(commandname, server_keylist.count + 1, &server_keylist, retline);
 		//printf("query retline: %s\n", retline);
 		sendall(sock, retline, sizeof(retline));
 	    }
 	    free(testque);
 	    testque = NULL;
+	    keylist_free(&server_keylist);
+	}
+	else if((*auth_success) == 0){
+	    cleanstring(retline);
+	    sprintf(retline, "&QUERY&$FAIL$^AUTH^");
+	    sendall(sock, retline, sizeof(retline));
 	}
 	else{
 	    //table doesn't exist
@@ -441,6 +477,311 @@ int handle_command(int sock, char *cmd, FILE *fptr, struct config_params *params
 	}
 	puts("%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%HANDLEQUERY_END%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%");
     }
+    else if(strcmp(commandname, "OPEN") == 0) {//open a QUERY cursor
+	struct queryarg *testque = (struct queryarg *)calloc(1, sizeof(struct queryarg));
+	struct queryprog queprog;
+	int columns[MAX_COLUMNS_PER_TABLE];
+	int numcolumns = -1;//keys only
+	char *query = valuename;
+	int numque = 0;
+	cleanstring(retline);
+	for(i = 0; i < MAX_CURSORS && cursors[i].open; i++);
+	if((*auth_success) == 0){
+	    sprintf(retline, "&OPEN&$FAIL$^AUTH^");
+	}
+	else if((index = find_index(params, tablename)) == -1){
+	    sprintf(retline, "&OPEN&$FAIL$^TABLE^");
+	}
+	else if((valuename[0] == '*' && (numcolumns = projection_argument(valuename, &tables[index].schema, columns, &query)) == -1)
+		|| (numque = query_argument(testque, query)) == -1
+		|| query_compile(&queprog, testque, numque, &tables[index]) != 0){
+	    sprintf(retline, "&OPEN&$FAIL$^INVALID^");
+	}
+	else if(i == MAX_CURSORS){
+	    sprintf(retline, "&OPEN&$FAIL$^CURSOR^");
+	}
+	else {
+	    cursors[i].open = true;
+	    cursors[i].table = index;
+	    cursors[i].next = 0;
+	    cursors[i].returned = 0;
+	    cursors[i].numcolumns = numcolumns;
+	    memcpy(cursors[i].columns, columns, sizeof(columns));
+	    strcpy(cursors[i].predicates, query);
+	    sprintf(retline, "&OPEN&$SUCCESS$#%d#", i);
+	}
+	free(testque);
+	sendall(sock, retline, sizeof(retline));
+    }
+    else if(strcmp(commandname, "FETCH") == 0) {//next page of a QUERY cursor
+	//#<cursor>##<max_keys>#
+	struct queryarg *testque = (struct queryarg *)calloc(1, sizeof(struct queryarg));
+	struct queryprog queprog;
+	struct keylist server_keylist;
+	struct city *found[CURSOR_PAGE];
+	int numque = 0;
+	int id = -1;
+	int max_keys = 0;
+	int sent = 0;
+	int done = 0;
+	unsigned int first = 0;
+	unsigned long version = 0;
+	keylist_init(&server_keylist);
+	cleanstring(retline);
+	if((*auth_success) == 0){
+	    sprintf(retline, "&FETCH&$FAIL$^AUTH^");
+	}
+	else if(sscanf(valuename, "#%d##%d#", &id, &max_keys) != 2 || id < 0 || id >= MAX_CURSORS || !cursors[id].open
+	   || (index = find_index(params, tablename)) != cursors[id].table){
+	    sprintf(retline, "&FETCH&$FAIL$^CURSOR^");
+	}
+	else if((numque = query_argument(testque, cursors[id].predicates)) == -1
+		|| query_compile(&queprog, testque, numque, &tables[index]) != 0){
+	    sprintf(retline, "&FETCH&$FAIL$^INVALID^");
+	}
+	else {
+	    if(max_keys <= 0 || max_keys > CURSOR_PAGE){
+		max_keys = CURSOR_PAGE;
+	    }
+	    if(queprog.limit >= 0 && queprog.limit - cursors[id].returned < (unsigned long)max_keys){
+		max_keys = queprog.limit - cursors[id].returned;
+	    }
+	    if(max_keys == 0){
+		done = 1;//LIMIT reached
+		encode_queryret(commandname, 1, &server_keylist, retline);
+	    }
+	    else if(queprog.order >= 0){
+		//keys after the last one sent, the order a slot can't give
+		done = query_top(&server_keylist, found, &queprog, &tables[index], cursors[id].returned > 0,
+				 &cursors[id].lastvalue, &cursors[id].next, max_keys);
+		sent = server_keylist.count;
+		if(cursors[id].numcolumns >= 0){
+		    sent = encode_queryrows(commandname, &tables[index], found, server_keylist.count, cursors[id].columns, cursors[id].numcolumns, retline);
+		    if(sent < server_keylist.count && sent > 0){
+			cursors[id].lastvalue = row_int(found[sent - 1]->row, &tables[index].schema.columns[queprog.order]);
+			cursors[id].next = found[sent - 1]->slot;
+			done = 0;
+		    }
+		}
+		else {
+		    encode_queryret(commandname, server_keylist.count + 1, &server_keylist, retline);
+		}
+	    }
+	    else if(cursors[id].numcolumns >= 0){
+		//rows are read under this epoch, so they are never cached
+		done = cursor_fetch(&server_keylist, found, &queprog, &tables[index], &cursors[id].next, max_keys);
+		sent = encode_queryrows(commandname, &tables[index], found, server_keylist.count, cursors[id].columns, cursors[id].numcolumns, retline);
+		if(sent < server_keylist.count){
+		    //the rest of the page goes with the next FETCH
+		    cursors[id].next = found[sent]->slot;
+		    done = 0;
+		}
+	    }
+	    else {
+		//a dashboard asking again before any SET is answered from the cache
+		version = LOAD_ACQUIRE(tables[index].version);
+		first = cursors[id].next;
+		done = querycache_get(&server_keylist, &tables[index], index, version, &queprog, &cursors[id].next, max_keys);
+		if(done == -1){
+		    done = cursor_fetch(&server_keylist, NULL, &queprog, &tables[index], &cursors[id].next, max_keys);
+		    querycache_put(&server_keylist, index, version, &queprog, first, cursors[id].next, done, max_keys);
+		}
+		encode_queryret(commandname, server_keylist.count + 1, &server_keylist, retline);
+		sent = server_keylist.count;
+	    }
+	    cursors[id].returned += sent;
+	    if(queprog.limit >= 0 && cursors[id].returned >= (unsigned long)queprog.limit){
+		done = 1;
+	    }
+	    if(done == -1){
+		sprintf(retline, "&FETCH&$FAIL$^MEMORY^");
+	    }
+	    else if(cursors[id].numcolumns >= 0 && sent == 0 && server_keylist.count > 0){
+		sprintf(retline, "&FETCH&$FAIL$^INVALID^");//a row longer than a reply line
+	    }
+	    else if(done){
+		//the last page reads $END$ instead and closes the cursor
+		char *matches = strchr(retline, '#');
+		memmove(retline + strlen("&FETCH&$END$"), matches, strlen(matches) + 1);
+		memcpy(retline, "&FETCH&$END$", strlen("&FETCH&$END$"));
+		cursors[id].open = false;
+	    }
+	}
+	free(testque);
+	keylist_free(&server_keylist);
+	sendall(sock, retline, sizeof(retline));
+    }
+    else if(strcmp(commandname, "CLOSE") == 0) {//close a QUERY cursor
+	int id = -1;
+	cleanstring(retline);
+	if((*auth_success) == 0){
+	    sprintf(retline, "&CLOSE&$FAIL$^AUTH^");
+	}
+	else if(sscanf(valuename, "#%d#", &id) != 1 || id < 0 || id >= MAX_CURSORS || !cursors[id].open){
+	    sprintf(retline, "&CLOSE&$FAIL$^CURSOR^");
+	}
+	else {
+	    cursors[id].open = false;
+	    sprintf(retline, "&CLOSE&$SUCCESS$");
+	}
+	sendall(sock, retline, sizeof(retline));
+    }
+    else if(strcmp(commandname, "AGGR") == 0) {//COUNT, SUM, MIN, MAX or AVG over the matches of a QUERY
+	struct queryarg *testque = (struct queryarg *)calloc(1, sizeof(struct queryarg));
+	struct queryprog queprog;
+	struct aggregate result;
+	char function[MAXLEN];
+	char column[MAXLEN];
+	char value[32];//one number, "%.17g" at most 24 characters
+	char *query;
+	int numque = 0;
+	int j = -1;//aggregated column, -1 to count records
+	bool real = false;
+	cleanstring(retline);
+	if((*auth_success) == 0){
+	    sprintf(retline, "&AGGR&$FAIL$^AUTH^");
+	}
+	else if((index = find_index(params, tablename)) == -1){
+	    sprintf(retline, "&AGGR&$FAIL$^TABLE^");
+	}
+	else if(aggregate_argument(valuename, function, column, &query) != 0
+		|| (numque = query_argument(testque, query)) == -1
+		|| query_compile(&queprog, testque, numque, &tables[index]) != 0
+		|| (column[0] != '\0' && (j = schema_column(&tables[index].schema, column)) < 0)
+		|| (strcmp(function, "COUNT") != 0 && (j < 0 || tables[index].schema.columns[j].type == COLUMN_STR))
+		|| (strcmp(function, "COUNT") != 0 && strcmp(function, "SUM") != 0 && strcmp(function, "MIN") != 0
+		    && strcmp(function, "MAX") != 0 && strcmp(function, "AVG") != 0)){
+	    //unknown function or column, or a string column for anything but COUNT
+	    sprintf(retline, "&AGGR&$FAIL$^INVALID^");
+	}
+	else {
+	    if(strcmp(function, "COUNT") == 0){
+		j = -1;
+	    }
+	    real = j >= 0 && tables[index].schema.columns[j].type == COLUMN_FLOAT;
+	    query_aggregate(&result, &queprog, &tables[index], j);
+	    value[0] = '\0';//MIN, MAX and AVG of no records
+	    if(strcmp(function, "COUNT") == 0){
+		sprintf(value, "%lu", result.count);
+	    }
+	    else if(strcmp(function, "SUM") == 0){
+		if(real){
+		    sprintf(value, "%.17g", result.sum);
+		}
+		else {
+		    sprintf(value, "%lld", result.total);
+		}
+	    }
+	    else if(result.count > 0 && strcmp(function, "AVG") == 0){
+		sprintf(value, "%.17g", (real ? result.sum : (double)result.total) / result.count);
+	    }
+	    else if(result.count > 0 && real){
+		sprintf(value, "%.9g", key_float(strcmp(function, "MIN") == 0 ? result.min : result.max));
+	    }
+	    else if(result.count > 0){
+		sprintf(value, "%d", strcmp(function, "MIN") == 0 ? result.min : result.max);
+	    }
+	    snprintf(retline, sizeof(retline), "&AGGR&$SUCCESS$#%lu#$%s$", result.count, value);
+	}
+	free(testque);
+	sendall(sock, retline, sizeof(retline));
+    }
+    else if(strcmp(commandname, "SCAN") == 0) {//range or prefix scan in key order
+	char mode;
+	char first[MAX_KEY_LEN+1];
+	char last[MAX_KEY_LEN+1];
+	int max_keys = 0;
+	int numkeys = 0;
+	cleanstring(retline);
+	if((*auth_success) == 0){
+	    sprintf(retline, "&SCAN&$FAIL$^AUTH^");
+	}
+	else if((index = find_index(params, tablename)) == -1){
+	    sprintf(retline, "&SCAN&$FAIL$^TABLE^");
+	}
+	else if(scan_argument(valuename, &mode, first, last, &max_keys) != 0){
+	    sprintf(retline, "&SCAN&$FAIL$^PARAM^");
+	}
+	else {
+	    struct keylist server_keylist;
+	    keylist_init(&server_keylist);
+	    //a reply line holds CURSOR_PAGE keys, the client asks again for more
+	    numkeys = scan_write(&server_keylist, &tables[index], mode, first, last,
+				 max_keys < CURSOR_PAGE ? max_keys : CURSOR_PAGE);
+	    encode_queryret(commandname, numkeys + 1, &server_keylist, retline);
+	    keylist_free(&server_keylist);
+	}
+	sendall(sock, retline, sizeof(retline));
+    }
+    else if(strcmp(commandname, "EXPLAIN") == 0) {//plan of a QUERY, run to count its matches
+	struct queryarg *testque = (struct queryarg *)calloc(1, sizeof(struct queryarg));
+	struct queryprog queprog;
+	struct aggregate result;
+	char plan[MAXLEN - (sizeof("&EXPLAIN&$SUCCESS$") - 1)];//all that fits after the prefix
+	int numque = 0;
+	cleanstring(retline);
+	if((*auth_success) == 0){
+	    sprintf(retline, "&EXPLAIN&$FAIL$^AUTH^");
+	}
+	else if((index = find_index(params, tablename)) == -1){
+	    sprintf(retline, "&EXPLAIN&$FAIL$^TABLE^");
+	}
+	else if((numque = query_argument(testque, valuename)) == -1
+		|| query_compile(&queprog, testque, numque, &tables[index]) != 0){
+	    sprintf(retline, "&EXPLAIN&$FAIL$^INVALID^");
+	}
+	else {
+	    query_aggregate(&result, &queprog, &tables[index], -1);
+	    query_explain(&queprog, &tables[index], result.count, plan, sizeof(plan));
+	    snprintf(retline, sizeof(retline), "&EXPLAIN&$SUCCESS$%s", plan);
+	}
+	free(testque);
+	sendall(sock, retline, sizeof(retline));
+    }
+    else if(strcmp(commandname, "COUNT") == 0) {//number of matches of a QUERY, without their keys
+	struct queryarg *testque = (struct queryarg *)calloc(1, sizeof(struct queryarg));
+	struct queryprog queprog;
+	int numque = 0;
+	cleanstring(retline);
+	if((*auth_success) == 0){
+	    sprintf(retline, "&COUNT&$FAIL$^AUTH^");
+	}
+	else if((index = find_index(params, tablename)) == -1){
+	    sprintf(retline, "&COUNT&$FAIL$^TABLE^");
+	}
+	else if((numque = query_argument(testque, valuename)) == -1
+		|| query_compile(&queprog, testque, numque, &tables[index]) != 0){
+	    sprintf(retline, "&COUNT&$FAIL$^INVALID^");
+	}
+	else {
+	    sprintf(retline, "&COUNT&$SUCCESS$#%lu#", query_count(&queprog, &tables[index]));
+	}
+	free(testque);
+	sendall(sock, retline, sizeof(retline));
+    }
+    else if(strcmp(commandname, "STATS") == 0) {//table occupancy
+	int used;
+	cleanstring(retline);
+	if((*auth_success) == 0){
+	    sprintf(retline, "&STATS&$FAIL$^AUTH^");
+	}
+	else if((index = find_index(params, tablename)) == -1){
+	    sprintf(retline, "&STATS&$FAIL$^TABLE^");
+	}
+	else {
+	    //the slab summary gets what the counters leave of the line
+	    used = snprintf(retline, sizeof(retline), "&STATS&$SUCCESS$records %lu strings %lu memory %lu evicted %lu hits %lu misses %lu slab ",
+			    tables[index].order.length, tables[index].strings.used, tables[index].memory, tables[index].evicted,
+			    tables[index].cachehits, tables[index].cachemisses);
+	    if(used > 0 && (size_t)used < sizeof(retline)){
+		slab_occupancy(&tables[index].slab, retline + used, sizeof(retline) - used);
+	    }
+	}
+	sendall(sock, retline, sizeof(retline));
+    }
+    if (ebr_slot != -1){
+	ebr_exit(ebr_slot);
+    }
     sendall(sock, "\n", 1);
     return 0;
 }
@@ -461,7 +802,7 @@ void * threadCallFunction(void *arg) {
 		}
 		else {
 			// Handle the command from the client.
-			int status = handle_command(tiInfo->clientsock, cmd, tiInfo->fileptr, tiInfo->params, tiInfo->headlist, &(tiInfo->auth_success));
+			int status = handle_command(tiInfo->clientsock, cmd, tiInfo->fileptr, tiInfo->params, tiInfo->tables, &(tiInfo->auth_success), tiInfo->cursors);
 	
 			if (status != 0)
 				wait_for_commands = 0; // Oops.  An error occured.
@@ -495,13 +836,8 @@ int main(int argc, char *argv[])
     int k=0;
     
     int status = 0;
-    yyin = fopen(argv[1], "r");
     struct config_params params;
-    struct storage_record record_temp;
-    struct bigstring str;
-	int max_keys = 10;
-	char keynames[10][100];
-    yyparse(&params, &record_temp, &str, &max_keys, keynames, &status);
+    status = read_config(argv[1], &params);
     
     printf("port number: %d\n", params.server_port);
 
@@ -528,10 +864,13 @@ int main(int argc, char *argv[])
      
      
      
-    struct city **headlist=(struct city**)malloc(sizeof(struct city*) * MAX_TABLES);
-    for(k=0;k<100;k++){
-	headlist[k]=(struct city*)malloc(sizeof(struct city));
+    build_tableindex(&params);
+    struct citytable *tables=(struct citytable*)malloc(sizeof(struct citytable) * (params.num_tables + 1));
+    for(k=0;k<params.num_tables;k++){
+	init_citytable(&tables[k], params.columnlist[k], params.num_columns[k]);
     }
+    query_pool_start(params.query_threads, params.parallel_rows);
+    querycache_init(params.query_cache);
     //End of variable declarations
     
     if(flag!=1&&LOGGING==2){
@@ -760,6 +1099,8 @@ int main(int argc, char *argv[])
 		}
 		
 		int auth_success = 0;
+		struct querycursor cursors[MAX_CURSORS];
+		memset(cursors, 0, sizeof(cursors));
 		
 		// Get commands from client.
 		int wait_for_commands = 1;
@@ -774,8 +1115,7 @@ int main(int argc, char *argv[])
 		    }
 			else {
 			    // Handle the command from the client.
-			    //printf("OUTSIDE %p", headlist);
-			    int status = handle_command(clientsock, cmd, fileptr, &params, headlist, &auth_success);
+			    int status = handle_command(clientsock, cmd, fileptr, &params, tables, &auth_success, cursors);
 			    
 			    if (status != 0)
 				wait_for_commands = 0; // Oops.  An error occured.
@@ -831,8 +1171,9 @@ int main(int argc, char *argv[])
 		
 		tiInfo->fileptr = fileptr;
 		tiInfo->params = &params;
-		tiInfo->headlist = headlist;
+		tiInfo->tables = tables;
 		tiInfo->auth_success = 0;
+		memset(tiInfo->cursors, 0, sizeof(tiInfo->cursors));
 		
 		
 		if (tiInfo->clientsock < 0) {	    
@@ -160,6 +160,43 @@ int storage_auth(const char *username, const char *passwd, void *conn)
 }
 
 
+/* Set by the reply grammar once a GET reply is read, so the next one starts afresh */
+extern int first_enter_3;
+
+/**
+ * @brief Whether the value of a GET reply, from value to end, holds a
+ * number the reply grammar can't read: its numbers are plain integers
+ * from 1-9, so any other float (12.5, -2, 0, 1e3) is taken as sent.
+ */
+static int unreadable_floats(const char *value, const char *end)
+{
+    char token[MAX_VALUE_LEN];
+    size_t len;
+    size_t digits;
+    int key;
+    
+    while (value < end)
+    {
+	len = strcspn(value, " ,");
+	if (value + len > end)
+	{
+	    len = end - value;
+	}
+	snprintf(token, sizeof token, "%.*s", (int)len, value);
+	if (parse_float(token, &key) == 0)
+	{
+	    digits = (token[0] == '-');
+	    if (token[digits] < '1' || token[digits] > '9'
+		|| strspn(token + digits, "0123456789") != strlen(token + digits))
+	    {
+		return 1;
+	    }
+	}
+	value += len + 1;
+    }
+    return 0;
+}
+
 int storage_get(const char *table, const char *key, struct storage_record *record, void *conn)
 {
 	// check parameter
@@ -267,13 +304,32 @@ int storage_get(const char *table, const char *key, struct storage_record *recor
 	    
 	    
 	    printf("buf: %s\n", buf);
-	    scan_string(buf);
 	    int error = 0;
+	    char *end = strstr(buf, " END COUNTER ");
 	    strcpy(record->value, "");
-	    error = yyparse(&param, record, &str, &max_keys, keynames, &status);
-	    if (error == -1)
+	    if (strncmp(buf, "GET SUCCESS ", strlen("GET SUCCESS ")) == 0 && end != NULL
+		&& unreadable_floats(buf + strlen("GET SUCCESS "), end))
 		{
-		    return -1;
+		    //taken as sent, a failed parse would leave the grammar's state behind
+		    snprintf(record->value, sizeof(record->value), "%.*s", (int)(end - buf - strlen("GET SUCCESS ")), buf + strlen("GET SUCCESS "));
+		    record->metadata[0] = atoi(end + strlen(" END COUNTER "));
+		}
+	    else
+		{
+		    scan_string(buf);
+		    error = yyparse(&param, record, &str, &max_keys, keynames, &status);
+		    if (error == -1)
+			{
+			    return -1;
+			}
+		    if (error != 0)
+			{
+			    //the reply didn't parse, don't hand back a partial value
+			    first_enter_3 = 1;
+			    strcpy(record->value, "");
+			    errno = ERR_UNKNOWN;
+			    return -1;
+			}
 		}
 		
 		printf("record->value: %s\n", record->value);
@@ -305,6 +361,64 @@ int storage_get(const char *table, const char *key, struct storage_record *recor
  * @brief This is just a minimal stub implementation.  You should modify it 
  * according to your design.
  */
+/**
+ * @brief Encode a record value that holds float literals.
+ *
+ * The value grammar has no rule for floats, so each "name value" pair
+ * is encoded on its own, which keeps the columns in order: numbers as
+ * @name@#value#!, floats the same as ints, and strings by the grammar.
+ * The client can't tell a float column from an int one, so "score 0"
+ * is a number like "score 0.5".
+ * @return The number of numbers, 0 if there are none and the whole value
+ * can go to the grammar, or -1 for a pair the grammar rejects or a
+ * value longer than size.
+ */
+static int encode_floats(const char *value, char *out, size_t size)
+{
+    struct config_params param;
+    struct storage_record record_temp;
+    struct bigstring str;
+    int max_keys = 10;
+    char keynames[10][100];
+    int status = 0;
+    char copy[MAX_VALUE_LEN];
+    char name[MAX_VALUE_LEN];
+    char literal[MAX_VALUE_LEN];
+    char rest;
+    char *pair;
+    int numbers = 0;
+    int key;
+    size_t len = 0;
+    int n;
+    
+    snprintf(copy, sizeof copy, "%s", value);
+    out[0] = '\0';
+    for (pair = strtok(copy, ","); pair != NULL; pair = strtok(NULL, ","))
+    {
+	if (sscanf(pair, " %s %s %c", name, literal, &rest) == 2 && parse_float(literal, &key) == 0)
+	{
+	    n = snprintf(out + len, size - len, "@%s@#%s#!", name, literal);
+	    numbers++;
+	}
+	else
+	{
+	    strcpy(str.string, "");
+	    scan_string(pair);
+	    if (yyparse(&param, &record_temp, &str, &max_keys, keynames, &status) != 0)
+	    {
+		return -1;
+	    }
+	    n = snprintf(out + len, size - len, "%s", str.string);
+	}
+	if (n < 0 || (size_t)n >= size - len)
+	{
+	    return -1;//cut short
+	}
+	len += n;
+    }
+    return numbers;
+}
+
 int storage_set(const char *table, const char *key, struct storage_record *record, void *conn)
 {
 	// check parameter
@@ -417,10 +531,17 @@ int storage_set(const char *table, const char *key, struct storage_record *recor
 	}
 	else
 	{
+		int error = encode_floats(record->value, str.string, sizeof str.string);
+		if (error == -1)
+		    {
+			errno = ERR_INVALID_PARAM;
+			return -1;
+		    }
+		if (error == 0)
+		{
 		strcpy(str.string, "");
 		//printf("record->value: %s\n\n\n", record->value);
 		scan_string(record->value);
-		int error = 0;
 		//printf("\n\n\nstr.string: %s\n\n\n", str.string);
 		error = yyparse(&param, &record_temp, &str, &max_keys, keynames, &status);
 		//printf("\n\n\nstr.string: %s\n\n\n", str.string);
@@ -428,6 +549,7 @@ int storage_set(const char *table, const char *key, struct storage_record *recor
 		    {
 			return -1;
 		    }
+		}
 		//printf("RECORD->VALUE: %s\n", str.string);
 		int counter = (int) record->metadata[0];
 		
@@ -436,6 +558,12 @@ int storage_set(const char *table, const char *key, struct storage_record *recor
 	}
 	printf("BUFFER: %s\n", buf);
 	if (sendall(sock, buf, strlen(buf)) == 0 && recvline(sock, buf, sizeof buf) == 0) {
+	    if (strcmp(buf, "SET FAIL QUOTA") == 0)
+		{
+		    // table is at the record quota of the server
+		    errno = ERR_UNKNOWN;
+		    return -1;
+		}
 		// Parsing SET
 	    scan_string(buf);
 	    int error = 0;
@@ -495,98 +623,637 @@ int storage_disconnect(void *conn)
 	return 0;
 }
 
+/**
+ * @brief A QUERY cursor open on the server, as storage_query_open() returns.
+ */
+struct storage_cursor {
+    int sock;
+    int id;
+    int done;//the server sent the last page and closed its side
+    char table[MAX_TABLE_LEN+1];
+};
+
+/**
+ * @brief Send an OPEN command for storage_query_open() and storage_query_open_rows().
+ *
+ * columns is NULL for a cursor over keys only.
+ */
+static void* storage_cursor_open(const char *table, const char *predicates, const char *columns, void *conn)
+{
+    struct storage_cursor *cursor;
+    int sock = (int)conn;
+    int id = 0;
+    int n = 0;
+    char buf[MAX_CMD_LEN];
+    char predicate_copy[1024];
+    
+    if (table == NULL || predicates == NULL || conn == NULL || strlen(predicates) >= sizeof predicate_copy
+	|| (columns != NULL && (strlen(columns) >= sizeof predicate_copy || strpbrk(columns, "*# ") != NULL)))
+    {
+	errno = ERR_INVALID_PARAM;
+	return NULL;
+    }
+    for (n = 0; table[n] != '\0'; n++)
+    {
+	if (!parser(table[n], 'T') || n >= MAX_TABLE_LEN)
+	{
+	    errno = ERR_INVALID_PARAM;
+	    return NULL;
+	}
+    }
+    strcpy(predicate_copy, predicates);
+    if (columns != NULL)
+    {
+	snprintf(buf, sizeof buf, "&OPEN&^%s^*%s*#0#", table, columns);
+    }
+    else
+    {
+	snprintf(buf, sizeof buf, "&OPEN&^%s^#0#", table);
+    }
+    if (orderparse(predicate_copy, buf) != 0)
+    {
+	errno = ERR_INVALID_PARAM;
+	return NULL;
+    }
+    add_equal(predicate_copy);
+    //an ORDER BY alone has no predicates to parse
+    if (predicate_copy[strspn(predicate_copy, " ")] != '\0' && queryparse(predicate_copy, buf) != 0)
+    {
+	//malformed predicate or a value of the wrong type
+	errno = ERR_INVALID_PARAM;
+	return NULL;
+    }
+    strcat(buf, "\n");
+    if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0)
+    {
+	errno = ERR_CONNECTION_FAIL;
+	return NULL;
+    }
+    if (sscanf(buf, "&OPEN&$SUCCESS$#%d#", &id) != 1)
+    {
+	if (strstr(buf, "^AUTH^") != NULL)
+	{
+	    errno = ERR_NOT_AUTHENTICATED;
+	}
+	else if (strstr(buf, "^TABLE^") != NULL)
+	{
+	    errno = ERR_TABLE_NOT_FOUND;
+	}
+	else if (strstr(buf, "^INVALID^") != NULL)
+	{
+	    errno = ERR_INVALID_PARAM;//unknown column or mismatched type
+	}
+	else
+	{
+	    errno = ERR_UNKNOWN;//includes every cursor of the connection in use
+	}
+	return NULL;
+    }
+    cursor = malloc(sizeof(struct storage_cursor));
+    cursor->sock = sock;
+    cursor->id = id;
+    cursor->done = 0;
+    strcpy(cursor->table, table);
+    return cursor;
+}
+
+void* storage_query_open(const char *table, const char *predicates, void *conn)
+{
+    return storage_cursor_open(table, predicates, NULL, conn);
+}
+
+void* storage_query_open_rows(const char *table, const char *predicates, const char *columns, void *conn)
+{
+    if (columns == NULL)
+    {
+	errno = ERR_INVALID_PARAM;
+	return NULL;
+    }
+    return storage_cursor_open(table, predicates, columns, conn);
+}
+
+/**
+ * @brief Send a FETCH command for storage_query_next() and storage_query_next_rows().
+ *
+ * records is NULL for a cursor over keys only.
+ */
+static int storage_cursor_next(void *cursor, char **keys, struct storage_record *records, const int max_keys)
+{
+    struct storage_cursor *cur = cursor;
+    char buf[MAX_CMD_LEN];
+    int n = 0;
+    
+    if (cur == NULL || keys == NULL || max_keys <= 0)
+    {
+	errno = ERR_INVALID_PARAM;
+	return -1;
+    }
+    if (cur->done)
+    {
+	return 0;
+    }
+    snprintf(buf, sizeof buf, "&FETCH&^%s^#%d##%d#\n", cur->table, cur->id, max_keys);
+    if (sendall(cur->sock, buf, strlen(buf)) != 0 || recvline(cur->sock, buf, sizeof buf) != 0)
+    {
+	errno = ERR_CONNECTION_FAIL;
+	return -1;
+    }
+    if (strncmp(buf, "&FETCH&$END$", strlen("&FETCH&$END$")) == 0)
+    {
+	cur->done = 1;
+    }
+    else if (strncmp(buf, "&FETCH&$SUCCESS$", strlen("&FETCH&$SUCCESS$")) != 0)
+    {
+	errno = strstr(buf, "^AUTH^") != NULL ? ERR_NOT_AUTHENTICATED
+	    : strstr(buf, "^INVALID^") != NULL ? ERR_INVALID_PARAM : ERR_UNKNOWN;
+	return -1;
+    }
+    if (records != NULL)
+    {
+	return decode_queryrows(buf, keys, records);
+    }
+    n = decode_queryret(buf, keys);
+    return n;
+}
+
+int storage_query_next(void *cursor, char **keys, const int max_keys)
+{
+    return storage_cursor_next(cursor, keys, NULL, max_keys);
+}
+
+int storage_query_next_rows(void *cursor, char **keys, struct storage_record *records, const int max_records)
+{
+    if (records == NULL)
+    {
+	errno = ERR_INVALID_PARAM;
+	return -1;
+    }
+    return storage_cursor_next(cursor, keys, records, max_records);
+}
+
+int storage_query_close(void *cursor)
+{
+    struct storage_cursor *cur = cursor;
+    char buf[MAX_CMD_LEN];
+    int status = 0;
+    
+    if (cur == NULL)
+    {
+	errno = ERR_INVALID_PARAM;
+	return -1;
+    }
+    if (!cur->done)
+    {
+	snprintf(buf, sizeof buf, "&CLOSE&^%s^#%d#\n", cur->table, cur->id);
+	if (sendall(cur->sock, buf, strlen(buf)) != 0 || recvline(cur->sock, buf, sizeof buf) != 0)
+	{
+	    errno = ERR_CONNECTION_FAIL;
+	    status = -1;
+	}
+    }
+    free(cur);
+    return status;
+}
+
 int storage_query(const char *table, const char *predicates, char **keys, const int max_keys, void *conn)
 {
-    //finds matching keys using predicates given and return the number of matching keys
-    //first, parse the predicates into separate conditions
-    printf("table: %s\n", table);
-    printf("predicate: %s\n", predicates);
-    printf("max_keys: %d\n", max_keys);
-    int matching_keys=0;
-    int questatus = 0;
-    int lim = 0;
-    int stat = 0;
-    int i = 0;
-    int j = 0;
+    //pages through a cursor, so any number of keys fits the replies
+    void *cursor;
+    char spare[CURSOR_PAGE][MAX_KEY_LEN + 1];
+    char *page[CURSOR_PAGE];
+    int matching_keys = 0;
+    int copied = 0;
+    int n = 0;
+    int i;
+    
+    if (keys == NULL || max_keys < 0)
+    {
+	errno = ERR_INVALID_PARAM;
+	return -1;
+    }
+    cursor = storage_query_open(table, predicates, conn);
+    if (cursor == NULL)
+    {
+	return -1;
+    }
+    for (i = 0; i < CURSOR_PAGE; i++)
+    {
+	page[i] = spare[i];
+    }
+    while ((n = copied < max_keys ? storage_query_next(cursor, keys + copied, max_keys - copied)
+	    : storage_query_next(cursor, page, CURSOR_PAGE)) > 0)
+    {
+	//keys past max_keys are only counted
+	if (copied < max_keys)
+	{
+	    copied += n;
+	}
+	matching_keys += n;
+    }
+    if (storage_query_close(cursor) != 0 || n == -1)
+    {
+	return -1;
+    }
+    return matching_keys;
+}
+
+int storage_query_rows(const char *table, const char *predicates, const char *columns, char **keys,
+		       struct storage_record *records, const int max_records, void *conn)
+{
+    //one round trip per page instead of a GET per key
+    void *cursor;
+    int matching_records = 0;
+    int n = 0;
+    
+    if (keys == NULL || records == NULL || max_records < 0)
+    {
+	errno = ERR_INVALID_PARAM;
+	return -1;
+    }
+    cursor = storage_query_open_rows(table, predicates, columns, conn);
+    if (cursor == NULL)
+    {
+	return -1;
+    }
+    while (matching_records < max_records
+	   && (n = storage_query_next_rows(cursor, keys + matching_records, records + matching_records,
+					   max_records - matching_records)) > 0)
+    {
+	matching_records += n;
+    }
+    if (storage_query_close(cursor) != 0 || n == -1)
+    {
+	return -1;
+    }
+    return matching_records;
+}
+
+int storage_aggregate(const char *table, const char *function, const char *column, const char *predicates, double *result, void *conn)
+{
     int sock = (int)conn;
+    int n = 0;
+    unsigned long count = 0;
     char buf[MAX_CMD_LEN];
-    char command[20];
-    char status[50];
-    char reason[50];
+    char value[MAX_CMD_LEN];
     char predicate_copy[1024];
     
-    add_equal(predicates);
-    while(predicates[i] != '\0'){
-	predicate_copy[i] = predicates[i];
-	i++;
-    }
-    predicate_copy[i] = '\0';
-    i = 0;
-    printf("predicate_copy: %s\n", predicate_copy);
-    printf("add equal successful\n");
-    //printf("predicates: %s\n", predicates);
-    sprintf(buf, "&QUERY&^%s^#%d#", table, max_keys);
-    printf("sprintf successful\n");
-    stat = queryparse(predicate_copy, buf);
-    printf("queryparse successful\n");
-    //printf("output: %s\n", buf);
+    if (table == NULL || function == NULL || column == NULL || result == NULL || conn == NULL
+	|| strchr(function, '*') != NULL || strchr(column, '*') != NULL)
+    {
+	errno = ERR_INVALID_PARAM;
+	return -1;
+    }
+    for (n = 0; table[n] != '\0'; n++)
+    {
+	if (!parser(table[n], 'T') || n >= MAX_TABLE_LEN)
+	{
+	    errno = ERR_INVALID_PARAM;
+	    return -1;
+	}
+    }
+    snprintf(buf, sizeof buf, "&AGGR&^%s^*%s**%s*#0#", table, function, column);
+    if (predicates != NULL && predicates[0] != '\0')
+    {
+	if (strlen(predicates) >= sizeof predicate_copy)
+	{
+	    errno = ERR_INVALID_PARAM;
+	    return -1;
+	}
+	strcpy(predicate_copy, predicates);
+	add_equal(predicate_copy);
+	if (queryparse(predicate_copy, buf) != 0)
+	{
+	    errno = ERR_INVALID_PARAM;
+	    return -1;
+	}
+    }
     strcat(buf, "\n");
-    //printf("buf: %s\n", buf);
-    if(sendall(sock, buf, strlen(buf)) == 0 && recvline(sock, buf, sizeof(buf)) == 0){
-	//printf("received buffer: %s\n", buf);
-	printf("recvline successful, query_buf: %s\n", buf);
-	i++;
-	while(buf[i] != '&'){
-	    command[j] = buf[i];
-	    i++;
-	    j++;
-	}
-	command[j] = '\0';
-	printf("command: %s\n", command);
-	i++;
-	i++;
-	j = 0;
-	while(buf[i] != '$'){
-	    status[j] = buf[i];
-	    i++;
-	    j++;
-	}
-	status[j] = '\0';
-	printf("status: %s\n", status);
-	i++;
-	j = 0;
-	if(buf[i] == '^'){
-	    i++;
-	    while(buf[i] != '^'){
-		reason[j] = buf[i];
-		i++;
-		j++;
-	    }
-	    reason[j] = '\0';
-	    printf("reason: %s\n", reason);
+    if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0)
+    {
+	errno = ERR_CONNECTION_FAIL;
+	return -1;
+    }
+    n = sscanf(buf, "&AGGR&$SUCCESS$#%lu#$%[^$]$", &count, value);
+    if (n < 1)
+    {
+	if (strstr(buf, "^AUTH^") != NULL)
+	{
+	    errno = ERR_NOT_AUTHENTICATED;
+	}
+	else if (strstr(buf, "^TABLE^") != NULL)
+	{
+	    errno = ERR_TABLE_NOT_FOUND;
+	}
+	else if (strstr(buf, "^INVALID^") != NULL)
+	{
+	    errno = ERR_INVALID_PARAM;
+	}
+	else
+	{
+	    errno = ERR_UNKNOWN;
+	}
+	return -1;
+    }
+    if (n == 1)
+    {
+	//MIN, MAX and AVG of no records
+	errno = ERR_KEY_NOT_FOUND;
+	return -1;
+    }
+    *result = strtod(value, NULL);
+    return 0;
+}
+
+int storage_count(const char *table, const char *predicates, void *conn)
+{
+    int sock = (int)conn;
+    int n = 0;
+    unsigned long count = 0;
+    char buf[MAX_CMD_LEN];
+    char predicate_copy[1024];
+    
+    if (table == NULL || predicates == NULL || conn == NULL || strlen(predicates) >= sizeof predicate_copy)
+    {
+	errno = ERR_INVALID_PARAM;
+	return -1;
+    }
+    for (n = 0; table[n] != '\0'; n++)
+    {
+	if (!parser(table[n], 'T') || n >= MAX_TABLE_LEN)
+	{
+	    errno = ERR_INVALID_PARAM;
+	    return -1;
+	}
+    }
+    strcpy(predicate_copy, predicates);
+    snprintf(buf, sizeof buf, "&COUNT&^%s^#0#", table);
+    if (orderparse(predicate_copy, buf) != 0)
+    {
+	errno = ERR_INVALID_PARAM;
+	return -1;
+    }
+    add_equal(predicate_copy);
+    if (predicate_copy[strspn(predicate_copy, " ")] != '\0' && queryparse(predicate_copy, buf) != 0)
+    {
+	errno = ERR_INVALID_PARAM;
+	return -1;
+    }
+    strcat(buf, "\n");
+    if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0)
+    {
+	errno = ERR_CONNECTION_FAIL;
+	return -1;
+    }
+    if (sscanf(buf, "&COUNT&$SUCCESS$#%lu#", &count) == 1)
+    {
+	return count > INT_MAX ? INT_MAX : (int)count;
+    }
+    if (strstr(buf, "^AUTH^") != NULL)
+    {
+	errno = ERR_NOT_AUTHENTICATED;
+    }
+    else if (strstr(buf, "^TABLE^") != NULL)
+    {
+	errno = ERR_TABLE_NOT_FOUND;
+    }
+    else if (strstr(buf, "^INVALID^") != NULL)
+    {
+	errno = ERR_INVALID_PARAM;
+    }
+    else
+    {
+	errno = ERR_UNKNOWN;
+    }
+    return -1;
+}
+
+int storage_explain(const char *table, const char *predicates, char *plan, const int len, void *conn)
+{
+    int sock = (int)conn;
+    int n = 0;
+    char buf[MAX_CMD_LEN];
+    char predicate_copy[1024];
+    const char *success = "&EXPLAIN&$SUCCESS$";
+    
+    if (table == NULL || predicates == NULL || plan == NULL || conn == NULL || len <= 0
+	|| strlen(predicates) >= sizeof predicate_copy)
+    {
+	errno = ERR_INVALID_PARAM;
+	return -1;
+    }
+    for (n = 0; table[n] != '\0'; n++)
+    {
+	if (!parser(table[n], 'T') || n >= MAX_TABLE_LEN)
+	{
+	    errno = ERR_INVALID_PARAM;
+	    return -1;
+	}
+    }
+    strcpy(predicate_copy, predicates);
+    snprintf(buf, sizeof buf, "&EXPLAIN&^%s^#0#", table);
+    if (orderparse(predicate_copy, buf) != 0)
+    {
+	errno = ERR_INVALID_PARAM;
+	return -1;
+    }
+    add_equal(predicate_copy);
+    if (predicate_copy[strspn(predicate_copy, " ")] != '\0' && queryparse(predicate_copy, buf) != 0)
+    {
+	errno = ERR_INVALID_PARAM;
+	return -1;
+    }
+    strcat(buf, "\n");
+    if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0)
+    {
+	errno = ERR_CONNECTION_FAIL;
+	return -1;
+    }
+    if (strncmp(buf, success, strlen(success)) == 0)
+    {
+	snprintf(plan, len, "%s", buf + strlen(success));
+	return 0;
+    }
+    if (strstr(buf, "^AUTH^") != NULL)
+    {
+	errno = ERR_NOT_AUTHENTICATED;
+    }
+    else if (strstr(buf, "^TABLE^") != NULL)
+    {
+	errno = ERR_TABLE_NOT_FOUND;
+    }
+    else if (strstr(buf, "^INVALID^") != NULL)
+    {
+	errno = ERR_INVALID_PARAM;
+    }
+    else
+    {
+	errno = ERR_UNKNOWN;
+    }
+    return -1;
+}
+
+/**
+ * @brief Send SCAN commands and copy the returned keys.
+ *
+ * Shared by storage_range() and storage_prefix(); mode is 'R' for a
+ * range and 'P' for a prefix, in which case last is unused.  A reply
+ * holds at most CURSOR_PAGE keys, so the scan goes on as a range from
+ * the last key returned, which comes back first and is skipped.
+ */
+static int storage_scan(const char *table, char mode, const char *first, const char *last, char **keys, const int max_keys, void *conn)
+{
+    int sock = (int)conn;
+    int n = 0;
+    int i, want;
+    int count = 0;
+    int resume = 0;
+    char buf[MAX_CMD_LEN];
+    char from[MAX_KEY_LEN + 1];
+    char pagekeys[CURSOR_PAGE][MAX_KEY_LEN + 1];
+    char *page[CURSOR_PAGE];
+    
+    if (table == NULL || first == NULL || last == NULL || keys == NULL || conn == NULL || max_keys < 0)
+    {
+	errno = ERR_INVALID_PARAM;
+	return -1;
+    }
+    for (n = 0; table[n] != '\0'; n++)
+    {
+	if (!parser(table[n], 'T') || n >= MAX_TABLE_LEN)
+	{
+	    errno = ERR_INVALID_PARAM;
+	    return -1;
+	}
+    }
+    for (n = 0; first[n] != '\0'; n++)
+    {
+	if (!parser(first[n], 'K') || n >= MAX_KEY_LEN)
+	{
+	    errno = ERR_INVALID_PARAM;
+	    return -1;
+	}
+    }
+    for (n = 0; last[n] != '\0'; n++)
+    {
+	if (!parser(last[n], 'K') || n >= MAX_KEY_LEN)
+	{
+	    errno = ERR_INVALID_PARAM;
+	    return -1;
+	}
+    }
+    for (i = 0; i < CURSOR_PAGE; i++)
+    {
+	page[i] = pagekeys[i];
+    }
+    strcpy(from, first);
+    for (;;)
+    {
+	want = max_keys - count + resume < CURSOR_PAGE ? max_keys - count + resume : CURSOR_PAGE;
+	//a prefix goes on as an open range, cut where the prefix ends
+	snprintf(buf, sizeof buf, "&SCAN&^%s^#%d#&%c&*%s**%s*\n", table, want,
+		 resume && mode == 'P' ? 'R' : mode, from, mode == 'P' ? "" : last);
+	if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0)
+	{
+	    errno = ERR_CONNECTION_FAIL;
+	    return -1;
 	}
-	else {
-	    matching_keys = decode_queryret(buf, keys);
+	if (strncmp(buf, "&SCAN&$SUCCESS$", strlen("&SCAN&$SUCCESS$")) != 0)
+	{
+	    break;
 	}
-	j = 0;
-	printf("matching keys = %d\n", matching_keys);
-	if(strcmp(status, "FAIL") == 0){
-	    if(strcmp(reason, "TABLE")){
-		printf("Query failed, table does not exist.\n");
+	n = decode_queryret(buf, page);
+	for (i = 0; i < n && count < max_keys; i++)
+	{
+	    if (resume && i == 0 && strcmp(page[0], from) == 0)
+	    {
+		continue;//ended the previous page
 	    }
+	    if (mode == 'P' && strncmp(page[i], first, strlen(first)) != 0)
+	    {
+		return count;
+	    }
+	    strcpy(keys[count], page[i]);
+	    count++;
+	}
+	if (n < want || count == max_keys)
+	{
+	    return count;//nothing left in the range, or no room left
+	}
+	strcpy(from, page[n - 1]);
+	resume = 1;
+    }
+    if (strstr(buf, "^AUTH^") != NULL)
+    {
+	errno = ERR_NOT_AUTHENTICATED;
+    }
+    else if (strstr(buf, "^TABLE^") != NULL)
+    {
+	errno = ERR_TABLE_NOT_FOUND;
+    }
+    else if (strstr(buf, "^PARAM^") != NULL)
+    {
+	errno = ERR_INVALID_PARAM;
+    }
+    else
+    {
+	errno = ERR_UNKNOWN;
+    }
+    return -1;
+}
+
+int storage_range(const char *table, const char *first, const char *last, char **keys, const int max_keys, void *conn)
+{
+    return storage_scan(table, 'R', first, last, keys, max_keys, conn);
+}
+
+int storage_prefix(const char *table, const char *prefix, char **keys, const int max_keys, void *conn)
+{
+    return storage_scan(table, 'P', prefix, "", keys, max_keys, conn);
+}
+
+int storage_stats(const char *table, char *stats, const int len, void *conn)
+{
+    int sock = (int)conn;
+    int n = 0;
+    char buf[MAX_CMD_LEN];
+    const char *success = "&STATS&$SUCCESS$";
+    
+    if (table == NULL || stats == NULL || conn == NULL || len <= 0)
+    {
+	errno = ERR_INVALID_PARAM;
+	return -1;
+    }
+    for (n = 0; table[n] != '\0'; n++)
+    {
+	if (!parser(table[n], 'T') || n >= MAX_TABLE_LEN)
+	{
+	    errno = ERR_INVALID_PARAM;
 	    return -1;
 	}
-	printf("max_keys = %d\n", max_keys);
     }
-    //return conditions
-    if(matching_keys > max_keys){
-	//# of matching keys exceeds the limit
-	return matching_keys;
+    
+    snprintf(buf, sizeof buf, "&STATS&^%s^\n", table);
+    if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0)
+    {
+	errno = ERR_CONNECTION_FAIL;
+	return -1;
     }
-    else if(max_keys == 0){
-	//given a limit of 0
-	
+    if (strncmp(buf, success, strlen(success)) == 0)
+    {
+	snprintf(stats, len, "%s", buf + strlen(success));
 	return 0;
     }
-    else return matching_keys;//all normal, return # of matching keys
+    if (strstr(buf, "^AUTH^") != NULL)
+    {
+	errno = ERR_NOT_AUTHENTICATED;
+    }
+    else if (strstr(buf, "^TABLE^") != NULL)
+    {
+	errno = ERR_TABLE_NOT_FOUND;
+    }
+    else
+    {
+	errno = ERR_UNKNOWN;
+    }
+    return -1;
 }
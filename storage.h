@@ -148,10 +148,233 @@ int storage_set(const char *table, const char *key, struct storage_record
  * separated by optional whitespace. The operator may be a "=" for string
  * types, or one of "<, >, =" for int and float types. An example of query
  * predicates is "name = bob, mark > 90".
+ *
+ * The predicates may end with "ORDER BY <column> [ASC|DESC]", for an int
+ * or float column, and "LIMIT <n>", as in "name = bob ORDER BY mark DESC
+ * LIMIT 10".  The server then sorts the matches and sends at most n keys.
  */
 int storage_query(const char *table, const char *predicates, char **keys, 
 		const int max_keys, void *conn);
 
+/**
+ * @brief Open a cursor over the keys of the records matching a query.
+ *
+ * @param table A table in the database.
+ * @param predicates A comma separated list of predicates, as in
+ * storage_query().
+ * @param conn A connection to the server.
+ * @return Return a cursor to pass to storage_query_next() if successful,
+ * and NULL otherwise.
+ *
+ * The server keeps only where the cursor is, not the matching keys, so a
+ * query may match any number of records.  Records set while the cursor
+ * is open may or may not be returned.  A connection has at most 4
+ * cursors open at once.
+ *
+ * On error, errno will be set to one of the following, as appropriate: 
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND,
+ * ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+void* storage_query_open(const char *table, const char *predicates, void *conn);
+
+/**
+ * @brief Retrieve the next page of keys from a cursor.
+ *
+ * @param cursor A cursor returned by storage_query_open().
+ * @param keys An array of strings where the keys will be copied.  The
+ * array must have room for at least max_keys elements.
+ * @param max_keys The size of the keys array.  The server may return
+ * fewer keys per page, at least one unless the cursor is at its end.
+ * @return Return the number of keys copied, 0 once every matching key
+ * has been returned, and -1 otherwise.
+ *
+ * On error, errno will be set as in storage_query_open().
+ */
+int storage_query_next(void *cursor, char **keys, const int max_keys);
+
+/**
+ * @brief Close a cursor and free it.
+ *
+ * @param cursor A cursor returned by storage_query_open().
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to ERR_INVALID_PARAM or ERR_CONNECTION_FAIL.
+ */
+int storage_query_close(void *cursor);
+
+/**
+ * @brief Retrieve the keys and records matching a query in one pass.
+ *
+ * @param table A table in the database.
+ * @param predicates A comma separated list of predicates, as in
+ * storage_query().
+ * @param columns A comma separated list of the columns to return, such
+ * as "name,mark", or "" for every column.
+ * @param keys An array of strings where the matching keys will be
+ * copied.  The array must have room for at least max_records elements.
+ * @param records An array where the record of each key is copied, with
+ * only the given columns in its value, as storage_get() would set it.
+ * @param max_records The size of the keys and records arrays.
+ * @param conn A connection to the server.
+ * @return Return the number of records copied, at most max_records,
+ * if successful, and -1 otherwise.
+ *
+ * The records come with the pages of the query, so no storage_get() is
+ * needed for the matching keys.
+ *
+ * On error, errno will be set as in storage_query_open().
+ */
+int storage_query_rows(const char *table, const char *predicates, const char *columns,
+		char **keys, struct storage_record *records, const int max_records, void *conn);
+
+/**
+ * @brief Open a cursor over the records matching a query.
+ *
+ * As storage_query_open(), for a cursor read with storage_query_next_rows();
+ * columns is as in storage_query_rows().
+ */
+void* storage_query_open_rows(const char *table, const char *predicates,
+		const char *columns, void *conn);
+
+/**
+ * @brief Retrieve the next page of keys and records from a cursor.
+ *
+ * @param cursor A cursor returned by storage_query_open_rows().
+ * @param keys An array of strings where the keys will be copied.
+ * @param records An array where the record of each key is copied.
+ * @param max_records The size of the keys and records arrays.
+ * @return As storage_query_next().
+ */
+int storage_query_next_rows(void *cursor, char **keys, struct storage_record *records,
+		const int max_records);
+
+/**
+ * @brief Compute an aggregate over the records matching a query.
+ *
+ * @param table A table in the database.
+ * @param function One of "COUNT", "SUM", "MIN", "MAX" or "AVG".
+ * @param column The int or float column aggregated; "" for COUNT.
+ * @param predicates A comma separated list of predicates, as in
+ * storage_query(), or "" for every record of the table.
+ * @param result Where the aggregate is copied.
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * The server aggregates in one pass over the matching records.  The
+ * SUM of no records is 0, and their MIN, MAX and AVG fail with
+ * ERR_KEY_NOT_FOUND.
+ *
+ * On error, errno will be set to one of the following, as appropriate: 
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND, 
+ * ERR_KEY_NOT_FOUND, ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_aggregate(const char *table, const char *function, const char *column,
+		const char *predicates, double *result, void *conn);
+
+/**
+ * @brief Count the records matching a query.
+ *
+ * @param table A table in the database.
+ * @param predicates A comma separated list of predicates, as in
+ * storage_query(), or "" for every record of the table.
+ * @param conn A connection to the server.
+ * @return Return the number of matching records, at most the LIMIT if
+ * one is given, if successful, and -1 otherwise.
+ *
+ * Only the number is sent back.  A single "=" on an indexed string
+ * column is answered from the index, and other queries are counted
+ * without reading the matching records.
+ *
+ * On error, errno will be set to one of the following, as appropriate: 
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND,
+ * ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_count(const char *table, const char *predicates, void *conn);
+
+/**
+ * @brief Describe how the server runs a query.
+ *
+ * @param table A table in the database.
+ * @param predicates A comma separated list of predicates, as in
+ * storage_query().
+ * @param plan Where the description is copied, such as
+ * "index mark; mark > 90 est 120, name = bob est 40; estimated 5 actual 3 of 5000":
+ * the index walked, "scan", or "top" and the column of an ORDER BY
+ * kept in a heap, then the predicates in the order they are
+ * checked with the records each is expected to pass, then the records
+ * expected and found to match all of them out of the table.  An estimate
+ * is "?" while the table has no statistics yet.
+ * @param len The size of plan.
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * The query is run to count its matches, but no keys are returned.
+ *
+ * On error, errno will be set to one of the following, as appropriate: 
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND,
+ * ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_explain(const char *table, const char *predicates, char *plan,
+		const int len, void *conn);
+
+/**
+ * @brief Retrieve the keys of a table that fall in a range, in key order.
+ *
+ * @param table A table in the database.
+ * @param first The smallest key to return, or "" to start at the first key.
+ * @param last The largest key to return, or "" to scan to the last key.
+ * @param keys An array of strings where the keys in the range will be
+ * copied.  The array must have room for at least max_keys elements.
+ * @param max_keys The size of the keys array.
+ * @param conn A connection to the server.
+ * @return Return the number of keys copied if successful, and -1 otherwise.
+ *
+ * A server reply holds a page of keys, so a long range takes a few
+ * round trips; keys set meanwhile may or may not be returned.
+ *
+ * On error, errno will be set to one of the following, as appropriate: 
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND, 
+ * ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_range(const char *table, const char *first, const char *last,
+		char **keys, const int max_keys, void *conn);
+
+/**
+ * @brief Retrieve the keys of a table that start with a prefix, in key order.
+ *
+ * @param table A table in the database.
+ * @param prefix The prefix the returned keys start with.
+ * @param keys An array of strings where the matching keys will be copied.
+ * The array must have room for at least max_keys elements.
+ * @param max_keys The size of the keys array.
+ * @param conn A connection to the server.
+ * @return Return the number of keys copied if successful, and -1 otherwise.
+ *
+ * On error, errno will be set as in storage_range().
+ */
+int storage_prefix(const char *table, const char *prefix, char **keys,
+		const int max_keys, void *conn);
+
+/**
+ * @brief Retrieve memory statistics of a table.
+ *
+ * @param table A table in the database.
+ * @param stats Where the statistics line is copied.
+ * @param len The size of the stats buffer.
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * The line reads "records <n> strings <distinct values> memory <bytes>
+ * evicted <n> hits <n> misses <n> slab <used bytes> <allocated bytes>", then
+ * "<chunk size>:<used>/<carved>" for every size class in use. memory is
+ * what the table_memory and max_memory caps are checked against; hits
+ * and misses count the query result pages answered from the server's
+ * cache or by scanning the table.
+ *
+ * On error, errno will be set as in storage_range().
+ */
+int storage_stats(const char *table, char *stats, const int len, void *conn);
+
 /**
  * @brief Close the connection to the server.
  *
@@ -9,9 +9,19 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
+#include <sched.h>
+#include <limits.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include "utils.h"
 
+int yyparse(struct config_params *param, struct storage_record *record, struct bigstring *str, int* max_keys, char keynames[][100], int* status);
+void scan_string(const char* str);
+
 unsigned int botRT, topRT;
 ThreadInfo runtimeThreads[MAX_CONNECTIONS];
 
@@ -111,6 +121,208 @@ int recvline(const int sock, char *buf, const size_t buflen)
     return status;
 }
 
+//Parses a byte count with an optional K, M or G suffix, 0 if malformed
+static unsigned long config_bytes(const char *text)
+{
+    char *end;
+    unsigned long bytes = strtoul(text, &end, 10);
+    if (end == text){
+	return 0;
+    }
+    switch (*end){
+    case 'K': case 'k': bytes <<= 10; end++; break;
+    case 'M': case 'm': bytes <<= 20; end++; break;
+    case 'G': case 'g': bytes <<= 30; end++; break;
+    }
+    return *end == '\0' ? bytes : 0;
+}
+
+/**
+ * Quota, memory cap, eviction and index directives and comments are
+ * handled here, every other line is handed to the config parser.
+ */
+int read_config(const char *config_file, struct config_params *params)
+{
+    struct storage_record record_temp;
+    struct bigstring str;
+    int max_keys = 10;
+    char keynames[10][100];
+    int status = 0;
+    char line[MAXLEN+1];
+    char word[MAXLEN+1];
+    char name[MAXLEN+1];
+    char amount[MAXLEN+1];
+    char kind[MAXLEN+1];
+    //table_memory, index and float columns, resolved once the tables are parsed
+    struct { char table[MAX_TABLE_LEN]; char column[MAX_STRTYPE_SIZE]; unsigned long bytes; bool real; bool bitmap; } *pending = NULL;
+    int numpending = 0;
+    int i, j, k;
+    long value;
+    char *text;
+    char *type;
+    size_t len = 0;
+    size_t capacity = MAXLEN+1;
+    FILE *file = fopen(config_file, "r");
+    if (file == NULL){
+	return -1;
+    }
+    memset(params, 0, sizeof(*params));
+    params->parallel_rows = PARALLEL_ROWS_DEFAULT;
+    params->query_cache = QUERY_CACHE_DEFAULT;
+    text = malloc(capacity);
+    text[0] = '\0';
+    while (fgets(line, sizeof(line), file) != NULL){
+	if (line[0] == CONFIG_COMMENT_CHAR){
+	    continue;
+	}
+	kind[0] = '\0';
+	if (sscanf(line, "%s %s %s %s", word, name, amount, kind) >= 3
+	    && (strcmp(word, "table_memory") == 0 || strcmp(word, "index") == 0)){
+	    //"table_memory <table> <bytes>" or "index <table> <column> [bitmap]"
+	    pending = realloc(pending, (numpending + 1) * sizeof(*pending));
+	    if (strlen(name) >= MAX_TABLE_LEN || (word[0] == 'i' && strlen(amount) >= MAX_STRTYPE_SIZE)){
+		status = -1;//a cut name could match another table or column
+	    }
+	    snprintf(pending[numpending].table, MAX_TABLE_LEN, "%.*s", MAX_TABLE_LEN - 1, name);
+	    pending[numpending].column[0] = '\0';
+	    pending[numpending].bytes = 0;
+	    pending[numpending].real = false;
+	    pending[numpending].bitmap = strcmp(kind, "bitmap") == 0;
+	    if (kind[0] != '\0' && (word[0] != 'i' || !pending[numpending].bitmap)){
+		status = -1;
+	    }
+	    if (word[0] == 'i'){
+		snprintf(pending[numpending].column, MAX_STRTYPE_SIZE, "%.*s", MAX_STRTYPE_SIZE - 1, amount);
+	    }
+	    else if ((pending[numpending].bytes = config_bytes(amount)) == 0){
+		status = -1;
+	    }
+	    numpending++;
+	    continue;
+	}
+	if (sscanf(line, "%s %s", word, amount) == 2){
+	    if (strcmp(word, "max_memory") == 0){
+		params->max_memory = config_bytes(amount);
+		if (params->max_memory == 0){
+		    status = -1;
+		}
+		continue;
+	    }
+	    if (strcmp(word, "eviction") == 0){
+		if (strcmp(amount, "lru") == 0){
+		    params->eviction = EVICT_LRU;
+		}
+		else if (strcmp(amount, "random") == 0){
+		    params->eviction = EVICT_RANDOM;
+		}
+		else if (strcmp(amount, "ttl") == 0){
+		    params->eviction = EVICT_TTL;
+		}
+		else {
+		    status = -1;
+		}
+		continue;
+	    }
+	}
+	if (sscanf(line, "%s %ld", word, &value) == 2){
+	    //a negative quota would wrap to a huge unsigned one
+	    if (value < 0 || (value < 1 && (strcmp(word, "query_threads") == 0 || strcmp(word, "parallel_rows") == 0))
+		|| (value > INT_MAX && (strcmp(word, "max_tables") == 0 || strcmp(word, "query_threads") == 0))){
+		status = -1;
+	    }
+	    if (strcmp(word, "max_tables") == 0){
+		params->max_tables = value;
+		continue;
+	    }
+	    if (strcmp(word, "max_records") == 0){
+		params->max_records = value;
+		continue;
+	    }
+	    if (strcmp(word, "query_threads") == 0){
+		params->query_threads = value;
+		continue;
+	    }
+	    if (strcmp(word, "parallel_rows") == 0){
+		params->parallel_rows = value;
+		continue;
+	    }
+	    if (strcmp(word, "query_cache") == 0){
+		params->query_cache = value;
+		continue;
+	    }
+	}
+	//the parser only knows int and char[SIZE], so a float column is
+	//declared to it as an int and marked once the tables are parsed
+	while (sscanf(line, "%s %s", word, name) == 2 && strcmp(word, "table") == 0
+	       && (type = strstr(line, ":float")) != NULL){
+	    for (i = type - line; i > 0 && line[i - 1] != ' ' && line[i - 1] != ',' && line[i - 1] != '\t'; i--);
+	    pending = realloc(pending, (numpending + 1) * sizeof(*pending));
+	    if (strlen(name) >= MAX_TABLE_LEN){
+		status = -1;
+	    }
+	    snprintf(pending[numpending].table, MAX_TABLE_LEN, "%.*s", MAX_TABLE_LEN - 1, name);
+	    j = type - line - i < MAX_STRTYPE_SIZE - 1 ? type - line - i : MAX_STRTYPE_SIZE - 1;
+	    memcpy(pending[numpending].column, line + i, j);
+	    pending[numpending].column[j] = '\0';
+	    pending[numpending].bytes = 0;
+	    pending[numpending].real = true;
+	    pending[numpending].bitmap = false;
+	    numpending++;
+	    memcpy(type, ":int", strlen(":int"));
+	    memmove(type + strlen(":int"), type + strlen(":float"), strlen(type + strlen(":float")) + 1);
+	}
+	if (len + strlen(line) + 1 > capacity){
+	    capacity = (len + strlen(line) + 1) * 2;
+	    text = realloc(text, capacity);
+	}
+	strcpy(text + len, line);
+	len += strlen(line);
+    }
+    fclose(file);
+    scan_string(text);
+    if (yyparse(params, &record_temp, &str, &max_keys, keynames, &status) != 0){
+	status = -1;
+    }
+    for (i = 0; i < numpending && status != -1; i++){
+	k = 0;
+	while (k < params->num_tables && strcmp(params->tablelist[k], pending[i].table) != 0){
+	    k++;
+	}
+	if (k == params->num_tables){
+	    status = -1;//table isn't declared
+	}
+	else if (pending[i].column[0] == '\0'){
+	    params->memory_caps[k] = pending[i].bytes;
+	}
+	else {
+	    j = 0;
+	    while (j < params->num_columns[k] && strcmp(params->columnlist[k][j].typename, pending[i].column) != 0){
+		j++;
+	    }
+	    if (j == params->num_columns[k]){
+		status = -1;//column isn't declared
+	    }
+	    else if (pending[i].real){
+		params->columnlist[k][j].real = true;
+	    }
+	    else if (pending[i].bitmap){
+		//a bitmap per value only pays off for strings with few values
+		if (!params->columnlist[k][j].flag){
+		    status = -1;
+		}
+		params->columnlist[k][j].index = INDEX_BITMAP;
+	    }
+	    else {
+		//strings only have '=', a hash index is enough for them
+		params->columnlist[k][j].index = params->columnlist[k][j].flag ? INDEX_HASH : INDEX_SORTED;
+	    }
+	}
+    }
+    free(pending);
+    free(text);
+    return status == -1 ? -1 : 0;
+}
+
 
 void logger(FILE *file, char *message)
 {
@@ -179,709 +391,3513 @@ bool parser(int input, char type)//For parsing parameters in the config file and
     else return false;
 }
 
-struct city* create_city(char* new_name, char *codedvalue)
+#define SLAB_HEADER ((sizeof(struct slabpage) + 15) & ~(size_t)15)
+
+void slab_init(struct slab *slab)
 {
-    struct city* new_city = malloc(sizeof(struct city));
-    //printf("codedvalue: %s\n", codedvalue);
-    new_city->counter = 1;
-    strncpy(new_city->name, new_name, sizeof(new_city->name));
-    new_city->numocolumns = decode_value(new_city, codedvalue);
-    //printf("newcitynumocolumns: %d\n", new_city->numocolumns);
-    new_city->next = NULL;
-    return new_city;
+    int i;
+    double size = SLAB_MIN_CHUNK;
+    for(i = 0; i < SLAB_CLASSES; i++){
+	//classes grow by 1.25 and stay 16-byte aligned
+	slab->classes[i].size = ((size_t)size + 15) & ~(size_t)15;
+	slab->classes[i].pages = NULL;
+	slab->classes[i].freelist = NULL;
+	slab->classes[i].carve = NULL;
+	slab->classes[i].carve_end = NULL;
+	slab->classes[i].total = 0;
+	slab->classes[i].used = 0;
+	size *= 1.25;
+    }
+    slab->large = NULL;
+    slab->large_bytes = 0;
+    slab->page_bytes = 0;
 }
 
-void insert_city(struct city *head, char *new_key, char *value_encoded)
+static struct slabclass* slab_class(struct slab *slab, size_t size)
 {
-    //printf("value_encoded: %s\n", value_encoded);
-    struct city* new_city = create_city(new_key, value_encoded);
-    //printf("new_city columns: %d\n", new_city->numocolumns);
-    if (head != NULL){
-	while (head->next != NULL){
-	    head = head->next;
+    int i;
+    for(i = 0; i < SLAB_CLASSES; i++){
+	if(size <= slab->classes[i].size){
+	    return &slab->classes[i];
 	}
-	
-	head->next = new_city;
-    }
-    else {
-		head = new_city;
     }
+    return NULL;
 }
 
-void modify_city(struct city *tempnode, char *value_encoded)
+void* slab_alloc(struct slab *slab, size_t size)
 {
-    (tempnode->counter)++;
-    tempnode->numocolumns = decode_value(tempnode, value_encoded);
+    struct slabclass *class = slab_class(slab, size);
+    struct slabpage *page;
+    void *chunk;
+
+    if(class == NULL){
+	//too big for any class, give it a page of its own
+	page = malloc(SLAB_HEADER + size);
+	if(page == NULL){
+	    return NULL;
+	}
+	page->chunksize = 0;
+	page->bytes = size;
+	page->next = slab->large;
+	slab->large = page;
+	slab->large_bytes += size;
+	return (char *)page + SLAB_HEADER;
+    }
+    if(class->freelist != NULL){
+	chunk = class->freelist;
+	class->freelist = *(void **)chunk;
+	class->used++;
+	return chunk;
+    }
+    if(class->carve == NULL || class->carve + class->size > class->carve_end){
+	page = malloc(SLAB_PAGE_SIZE);
+	if(page == NULL){
+	    return NULL;
+	}
+	page->chunksize = class->size;
+	page->bytes = SLAB_PAGE_SIZE;
+	page->next = class->pages;
+	class->pages = page;
+	class->carve = (char *)page + SLAB_HEADER;
+	class->carve_end = (char *)page + SLAB_PAGE_SIZE;
+	slab->page_bytes += SLAB_PAGE_SIZE;
+    }
+    chunk = class->carve;
+    class->carve += class->size;
+    class->total++;
+    class->used++;
+    return chunk;
 }
 
-int delete_city(struct city **head, char* name)
+void slab_free(struct slab *slab, void *ptr, size_t size)
 {
-    struct city* before;
-    struct city* this;
-    
-    if ((*head) == NULL){
-	//printf("The list is empty\n");
+    struct slabclass *class;
+    struct slabpage **link;
+
+    if(ptr == NULL){
+	return;
     }
-    else{
-	if (!strcmp((*head)->name, name)){
-			struct city* temp;
-			temp = (*head);
-	    
-	    if ((*head)->next != NULL){
-			(*head) = (*head)->next;
-			free(temp);
-	    }
-	    else{
-			free((*head));
-			(*head) = NULL;
+    class = slab_class(slab, size);
+    if(class == NULL){
+	for(link = &slab->large; *link != NULL; link = &(*link)->next){
+	    if((char *)*link + SLAB_HEADER == ptr){
+		slab->large_bytes -= (*link)->bytes;
+		*link = (*link)->next;
+		free((char *)ptr - SLAB_HEADER);
+		return;
 	    }
-	    
-	    return 0;
 	}
-	
-	before = this = (*head);
-	
-	while (before->next != NULL){
-	    this = before->next;
-	    
-	    if (!strcmp(this->name, name)){
-			before->next = this->next;
-			free(this);
-		
-		return 0;
-	    }
-	    else{
-			before = before->next;	
-	    }
+	return;
+    }
+    *(void **)ptr = class->freelist;
+    class->freelist = ptr;
+    class->used--;
+}
+
+void slab_release(struct slab *slab)
+{
+    //frees every chunk of the slab at once
+    struct slabpage *page;
+    struct slabpage *nextpage;
+    int i;
+    for(i = 0; i < SLAB_CLASSES; i++){
+	for(page = slab->classes[i].pages; page != NULL; page = nextpage){
+	    nextpage = page->next;
+	    free(page);
 	}
-	
-	printf("The city is not found\n");
     }
-    
-    return 0;
+    for(page = slab->large; page != NULL; page = nextpage){
+	nextpage = page->next;
+	free(page);
+    }
+    slab_init(slab);
 }
 
-struct city* find_city(struct city* head, char* name)
+int slab_occupancy(struct slab *slab, char *out, size_t len)
 {
-    if (head == NULL)
-    {
-		printf("head is null");
-		return NULL;
+    //"<used bytes> <allocated bytes>" followed by "<size>:<used>/<carved>" per class in use
+    unsigned long used = slab->large_bytes;
+    int written;
+    int i;
+    for(i = 0; i < SLAB_CLASSES; i++){
+	used += slab->classes[i].used * slab->classes[i].size;
     }
-    else{
-		while (head != NULL)
-		{
-			if (!strcmp(head->name, name))
-			{
-				printf("found head: %d\n", head->numocolumns);
-				printf("headname: %s\n", head->name);
-				return head;
-			}
-			else
-			{
-				//printf("traversing through list\n");
-				printf("headname: %s\n", head->name);
-				head = head->next;
-			}
+    written = snprintf(out, len, "%lu %lu", used, slab->page_bytes + slab->large_bytes);
+    for(i = 0; i < SLAB_CLASSES && written >= 0 && (size_t)written < len; i++){
+	if(slab->classes[i].total > 0){
+	    written += snprintf(out + written, len - written, " %lu:%lu/%lu",
+				(unsigned long)slab->classes[i].size, slab->classes[i].used, slab->classes[i].total);
 	}
-		return NULL;
     }
+    return written;
 }
 
-void print_city(struct city* this_city)
+static unsigned long ebr_epoch = 1;
+static unsigned long ebr_active[EBR_SLOTS];//epoch of each reader, 0 when free
+static struct ebr_retired *ebr_retired;//newest first, only touched under setMutex
+static struct ebr_retired ebr_reserve[EBR_RESERVE];//used when malloc fails
+static bool ebr_reserved[EBR_RESERVE];
+
+int ebr_enter(void)
 {
-    if (this_city != NULL){
-	int i = 0; //loop counter
-	//strncpy(pop, this_city->population, sizeof(pop));
-	
-	//printf("city name: %s\n", this_city->name);
-	//printf("numocolumns: %d\n", this_city->numocolumns);
-	//print_column(&this_city->columnlist[0]);
-	while(i < this_city->numocolumns){
-	    print_column(&this_city->columnlist[i]);
-	    i++;
+    unsigned long epoch, now;
+    unsigned long expected;
+    int slot;
+    for(;;){
+	for(slot = 0; slot < EBR_SLOTS; slot++){
+	    expected = 0;
+	    epoch = __atomic_load_n(&ebr_epoch, __ATOMIC_SEQ_CST);
+	    if(__atomic_compare_exchange_n(&ebr_active[slot], &expected, epoch, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)){
+		//republish until the epoch is stable so ebr_collect() can't miss us
+		while((now = __atomic_load_n(&ebr_epoch, __ATOMIC_SEQ_CST)) != epoch){
+		    __atomic_store_n(&ebr_active[slot], now, __ATOMIC_SEQ_CST);
+		    epoch = now;
+		}
+		return slot;
+	    }
 	}
+	sched_yield();
     }
-    else {
-	printf("the city is NULL\n");
+}
+
+void ebr_exit(int slot)
+{
+    __atomic_store_n(&ebr_active[slot], 0, __ATOMIC_RELEASE);
+}
+
+void ebr_retire(void (*reclaim)(void *owner, void *ptr), void *owner, void *ptr)
+{
+    struct ebr_retired *retired = malloc(sizeof(struct ebr_retired));
+    int i;
+    if(retired == NULL){
+	//ptr must still wait out its grace period, so take a reserve node
+	for(i = 0; i < EBR_RESERVE && ebr_reserved[i]; i++);
+	if(i == EBR_RESERVE){
+	    //never freeing ptr is safe, it's only lost
+	    fprintf(stderr, "ebr_retire: out of memory, leaking %p\n", ptr);
+	    return;
+	}
+	ebr_reserved[i] = true;
+	retired = &ebr_reserve[i];
     }
+    retired->epoch = __atomic_load_n(&ebr_epoch, __ATOMIC_SEQ_CST);
+    retired->reclaim = reclaim;
+    retired->owner = owner;
+    retired->ptr = ptr;
+    retired->next = ebr_retired;
+    ebr_retired = retired;
 }
 
-void print_list(struct city* head)
+void ebr_collect(void)
 {
-    if (head != NULL){
-	while (head != NULL){
-	    print_city(head);
-	    head = head->next;
+    //readers that entered after an epoch was left can't hold what was retired in it
+    unsigned long oldest = __atomic_add_fetch(&ebr_epoch, 1, __ATOMIC_SEQ_CST);
+    unsigned long epoch;
+    struct ebr_retired **link = &ebr_retired;
+    struct ebr_retired *retired;
+    int slot;
+    for(slot = 0; slot < EBR_SLOTS; slot++){
+	epoch = __atomic_load_n(&ebr_active[slot], __ATOMIC_SEQ_CST);
+	if(epoch != 0 && epoch < oldest){
+	    oldest = epoch;
 	}
     }
-    else {
-	printf("The list is empty\n");
+    while(*link != NULL && (*link)->epoch >= oldest){
+	link = &(*link)->next;
+    }
+    retired = *link;
+    *link = NULL;
+    while(retired != NULL){
+	struct ebr_retired *next = retired->next;
+	retired->reclaim(retired->owner, retired->ptr);
+	if(retired >= ebr_reserve && retired < ebr_reserve + EBR_RESERVE){
+	    ebr_reserved[retired - ebr_reserve] = false;
+	}
+	else {
+	    free(retired);
+	}
+	retired = next;
     }
-    
 }
 
-//Get function without overflowing target array
-void sget(char *s, int arraylength)
+static void reclaim_array(void *owner, void *ptr)
 {
-    int i=0;
-    char c;
-    while(i < arraylength-1 && (c=getchar())!='\n')
-	{   
-	    if(c!=127)
-		{
-		    s[i]=c;
-		    i++;
-		}
-	}
-    s[i]='\0';
-} 
+    (void)owner;//arrays are plain malloc blocks
+    free(ptr);
+}
 
+//Marks the start and end of a change lock-free readers must retry around
+static void seq_write_begin(unsigned long *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
 
-int find_index(char tablelist[MAX_TABLES][MAX_TABLE_LEN], char* name)
+static void seq_write_end(unsigned long *seq)
 {
-    int i = 0;
-    while (i < MAX_TABLES){
-	printf("tablelist %d: %s\n", i, tablelist[i]);
-	if (strcmp(tablelist[i], name) == 0){
-	    return i;
-	}
-	else i++;
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+static unsigned long seq_read_begin(unsigned long *seq)
+{
+    unsigned long start;
+    while((start = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1){
+	sched_yield();
     }
-    return -1;
+    return start;
 }
 
-int columncopy(struct column *source, struct column *dest)
+static bool seq_read_retry(unsigned long *seq, unsigned long start)
 {
-    strncpy(dest->typename, source->typename, sizeof(dest->typename));
-    dest->flag = source->flag;
-    if(dest->flag == true){
-	strncpy(dest->strval, source->strval, sizeof(dest->strval));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+#define CITYHASH_INITIAL_SIZE 16 ///< Buckets allocated for an empty table.
+#define CITYHASH_EMPTY_VISITS 10 ///< Empty buckets skipped per rehash step.
+
+unsigned int hash_key(const char *key)
+{
+    //32-bit FNV-1a
+    unsigned int hash = 2166136261u;
+    while(*key != '\0'){
+	hash ^= (unsigned char)*key;
+	hash *= 16777619u;
+	key++;
     }
-    else{
-	dest->intval = source->intval;
+    return hash;
+}
+
+int parse_float(const char *text, int *key)
+{
+    char *end;
+    float value = strtof(text, &end);
+    if(end == text || *end != '\0' || !isfinite(value)){
+	return -1;
     }
-    return 1;
-}  
+    *key = float_key(value);
+    return 0;
+}
 
-void cleanstring(char *string)
+void build_schema(struct schema *schema, struct column *columns, int numcolumns)
 {
-    int i = 0;
-    if(string != NULL){
-	while(string[i] != '\0'){
-	    i++;
+    //lays columns out in config order, string columns hold a strheap handle
+    int offset = 0;
+    int j;
+    schema->numcolumns = numcolumns;
+    for(j = 0; j < numcolumns; j++){
+	struct schemacolumn *column = &schema->columns[j];
+	strncpy(column->name, columns[j].typename, sizeof(column->name));
+	if(columns[j].flag == true){
+	    column->type = COLUMN_STR;
+	    column->size = sizeof(unsigned int);
+	    column->length = columns[j].size;
+	    if(column->length > MAX_VALUE_LEN - 1){
+		column->length = MAX_VALUE_LEN - 1;
+	    }
 	}
-	for(; i >= 0; i--){
-	    string[i] = '\0';
+	else {
+	    column->type = columns[j].real ? COLUMN_FLOAT : COLUMN_INT;
+	    column->size = sizeof(int);
+	    column->length = 0;
 	}
+	column->offset = offset;
+	column->index = columns[j].index;
+	offset += column->size;
     }
+    schema->rowsize = offset;
 }
 
-int count_column(char *source)
+int schema_column(struct schema *schema, const char *name)
 {
-    //reads value string and populates columns in that specific struct
-    printf("source: %s\n", source);
-    char tempint[1024];
-    bool typeflag = false;
-    bool strflag = false;
-    bool intflag = false;
-    int i = 0;//source string address
-    int j = 0;//dest column list
-    int k = 0;//char copy counter
-    k=0;
-
-    while(source[i] != '?' && source[i] != '\0'){
-	//printf("source[i] = %c \n", source[i]);
-	if(source[i] != '@' && typeflag == true){//write to typename
-	    k++;//increment char counter
-	}
-	else if(source[i] != '$' && strflag == true){//write to strval
-	    k++;//increment char counter
+    int j;
+    for(j = 0; j < schema->numcolumns; j++){
+	if(strcmp(schema->columns[j].name, name) == 0){
+	    return j;
 	}
-	else if(source[i] != '#' && intflag == true){//write to intval
-	    tempint[k] = source[i];//copy char to tempint for conversion later
-	    k++;//increment char counter
+    }
+    return -1;
+}
+
+//Copies old into a new array of size bytes and retires old
+static void* array_grow(void *old, size_t oldsize, size_t size)
+{
+    void *array = calloc(1, size);
+    if(old != NULL){
+	memcpy(array, old, oldsize);
+	ebr_retire(reclaim_array, NULL, old);
+    }
+    return array;
+}
+
+//Zone bounds for capacity slots, the new blocks set to empty
+static int* zone_grow(int *old, unsigned int oldcapacity, unsigned int capacity, int empty)
+{
+    int *zones = array_grow(old, COLSTORE_ZONES(oldcapacity) * sizeof(int), COLSTORE_ZONES(capacity) * sizeof(int));
+    unsigned int z;
+    for(z = COLSTORE_ZONES(oldcapacity); z < COLSTORE_ZONES(capacity); z++){
+	zones[z] = empty;
+    }
+    return zones;
+}
+
+static void colstore_grow(struct colstore *store, struct schema *schema)
+{
+    //readers load capacity first, so every array is published before it
+    unsigned int capacity = store->capacity ? store->capacity * 2 : COLSTORE_INITIAL_SLOTS;
+    int j;
+    for(j = 0; j < schema->numcolumns; j++){
+	STORE_RELEASE(store->values[j], array_grow(store->values[j], store->capacity * sizeof(int), capacity * sizeof(int)));
+    }
+    if(COLSTORE_ZONES(capacity) > COLSTORE_ZONES(store->capacity)){
+	for(j = 0; j < schema->numcolumns; j++){
+	    STORE_RELEASE(store->zonemin[j], zone_grow(store->zonemin[j], store->capacity, capacity, INT_MAX));
+	    STORE_RELEASE(store->zonemax[j], zone_grow(store->zonemax[j], store->capacity, capacity, INT_MIN));
 	}
-	//get dest ready
-	if(source[i] == '@'){//name encountered
-	    if(typeflag == true){//already enabled
-		typeflag = false;//disable (second '@' encountered)
-		k = 0;//reset char counter
-	    }
-	    else typeflag = true;
+    }
+    STORE_RELEASE(store->rows, array_grow(store->rows, store->capacity * sizeof(struct city *), capacity * sizeof(struct city *)));
+    STORE_RELEASE(store->valid, array_grow(store->valid, store->capacity / BITMAP_WORD_BITS * sizeof(unsigned long),
+					   capacity / BITMAP_WORD_BITS * sizeof(unsigned long)));
+    store->freeslots = realloc(store->freeslots, capacity * sizeof(unsigned int));
+    STORE_RELEASE(store->capacity, capacity);
+}
+
+//Copies the columns of a record into its slot, handles are stored as ints;
+//the zone is widened first so a scan never skips the new value
+static void colstore_sync(struct colstore *store, struct schema *schema, struct city *node)
+{
+    unsigned int zone = node->slot / ZONE_SLOTS;
+    int j, value;
+    for(j = 0; j < schema->numcolumns; j++){
+	value = row_int(node->row, &schema->columns[j]);
+	if(value < store->zonemin[j][zone]){
+	    __atomic_store_n(&store->zonemin[j][zone], value, __ATOMIC_RELEASE);
 	}
-	else if(source[i] == '$'){//string encountered
-	    if(strflag == true){
-		strflag = false;//second '$' encountered
-		k = 0;//reset char counter
-	    }
-	    else strflag = true;
+	if(value > store->zonemax[j][zone]){
+	    __atomic_store_n(&store->zonemax[j][zone], value, __ATOMIC_RELEASE);
 	}
-	else if(source[i] == '#'){//int encountered
-	    if(intflag == true){
-		intflag = false;//second '#' encountered
-		tempint[k] = '\0';
-		k = 0;//reset char counter
+	store->values[j][node->slot] = value;
+    }
+}
+
+//Rebuilds the zone bounds from the slots in use, dropping what deletes
+//and modifies left behind; new arrays are published whole
+static void colstore_rezone(struct colstore *store, struct schema *schema)
+{
+    unsigned int numzones = COLSTORE_ZONES(store->capacity);
+    unsigned int w, z, slot;
+    unsigned long bits;
+    int *zonemin, *zonemax;
+    int j, value;
+    for(j = 0; j < schema->numcolumns && numzones > 0; j++){
+	zonemin = zone_grow(NULL, 0, store->capacity, INT_MAX);
+	zonemax = zone_grow(NULL, 0, store->capacity, INT_MIN);
+	for(w = 0; w * BITMAP_WORD_BITS < store->high; w++){
+	    for(bits = store->valid[w]; bits != 0; bits &= bits - 1){
+		slot = w * BITMAP_WORD_BITS + __builtin_ctzl(bits);
+		z = slot / ZONE_SLOTS;
+		value = store->values[j][slot];
+		if(value < zonemin[z]){
+		    zonemin[z] = value;
+		}
+		if(value > zonemax[z]){
+		    zonemax[z] = value;
+		}
 	    }
-	    else intflag = true;
 	}
-	else if(source[i] == '!'){//column ends, go to next column
-	    j++;//increment column counter
+	zonemin = __atomic_exchange_n(&store->zonemin[j], zonemin, __ATOMIC_RELEASE);
+	zonemax = __atomic_exchange_n(&store->zonemax[j], zonemax, __ATOMIC_RELEASE);
+	ebr_retire(reclaim_array, NULL, zonemin);
+	ebr_retire(reclaim_array, NULL, zonemax);
+    }
+}
+
+static void colstore_add(struct colstore *store, struct schema *schema, struct city *node)
+{
+    if(store->numfree > 0){
+	node->slot = store->freeslots[--store->numfree];
+    }
+    else {
+	if(store->high == store->capacity){
+	    colstore_grow(store, schema);
 	}
-	i++;//increment i and repeat
+	node->slot = store->high;
+	STORE_RELEASE(store->high, store->high + 1);
     }
-    printf("j=%d\n", j);
-    return j;
+    colstore_sync(store, schema, node);
+    STORE_RELEASE(store->rows[node->slot], node);
+    __atomic_fetch_or(&store->valid[node->slot / BITMAP_WORD_BITS], 1UL << (node->slot % BITMAP_WORD_BITS), __ATOMIC_RELEASE);
+}
+
+static void colstore_remove(struct colstore *store, struct city *node)
+{
+    __atomic_fetch_and(&store->valid[node->slot / BITMAP_WORD_BITS], ~(1UL << (node->slot % BITMAP_WORD_BITS)), __ATOMIC_RELEASE);
+    STORE_RELEASE(store->rows[node->slot], NULL);
+    store->freeslots[store->numfree++] = node->slot;
 }
 
+static void colstore_release(struct colstore *store)
+{
+    int j;
+    for(j = 0; j < MAX_COLUMNS_PER_TABLE; j++){
+	free(store->values[j]);
+	free(store->zonemin[j]);
+	free(store->zonemax[j]);
+    }
+    free(store->rows);
+    free(store->valid);
+    free(store->freeslots);
+}
 
+/*
+ * Predicate kernels: each returns the bitmap word of the
+ * BITMAP_WORD_BITS values at values whose "value operator constant"
+ * holds. The widest one the CPU supports is picked on first use.
+ */
+typedef unsigned long (*filter_kernel)(const int *values, char operator, int constant);
 
-int decode_value(struct city *target, char *source)
+static unsigned long filter_word_scalar(const int *values, char operator, int constant)
+{
+    unsigned long bits = 0;
+    unsigned int i;
+    switch(operator){
+    case '<':
+	for(i = 0; i < BITMAP_WORD_BITS; i++){
+	    bits |= (unsigned long)(values[i] < constant) << i;
+	}
+	break;
+    case '>':
+	for(i = 0; i < BITMAP_WORD_BITS; i++){
+	    bits |= (unsigned long)(values[i] > constant) << i;
+	}
+	break;
+    default:
+	for(i = 0; i < BITMAP_WORD_BITS; i++){
+	    bits |= (unsigned long)(values[i] == constant) << i;
+	}
+	break;
+    }
+    return bits;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static unsigned long filter_word_sse2(const int *values, char operator, int constant)
+{
+    __m128i wanted = _mm_set1_epi32(constant);
+    __m128i v, cmp;
+    unsigned long bits = 0;
+    unsigned int i;
+    for(i = 0; i < BITMAP_WORD_BITS; i += 4){
+	v = _mm_loadu_si128((const __m128i *)(values + i));
+	cmp = operator == '<' ? _mm_cmplt_epi32(v, wanted)
+	    : operator == '>' ? _mm_cmpgt_epi32(v, wanted) : _mm_cmpeq_epi32(v, wanted);
+	bits |= (unsigned long)_mm_movemask_ps(_mm_castsi128_ps(cmp)) << i;
+    }
+    return bits;
+}
+
+__attribute__((target("avx2")))
+static unsigned long filter_word_avx2(const int *values, char operator, int constant)
+{
+    __m256i wanted = _mm256_set1_epi32(constant);
+    __m256i v, cmp;
+    unsigned long bits = 0;
+    unsigned int i;
+    for(i = 0; i < BITMAP_WORD_BITS; i += 8){
+	v = _mm256_loadu_si256((const __m256i *)(values + i));
+	cmp = operator == '<' ? _mm256_cmpgt_epi32(wanted, v)
+	    : operator == '>' ? _mm256_cmpgt_epi32(v, wanted) : _mm256_cmpeq_epi32(v, wanted);
+	bits |= (unsigned long)(unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(cmp)) << i;
+    }
+    return bits;
+}
+#endif
+
+static filter_kernel filter_word;
+
+static filter_kernel filter_select(void)
+{
+    filter_kernel kernel = LOAD_ACQUIRE(filter_word);
+    if(kernel != NULL){
+	return kernel;
+    }
+    kernel = filter_word_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+	kernel = filter_word_avx2;
+    }
+    else if(__builtin_cpu_supports("sse2")){
+	kernel = filter_word_sse2;
+    }
+#endif
+    STORE_RELEASE(filter_word, kernel);//every thread picks the same one
+    return kernel;
+}
+
+//Clears the bits of match whose slot fails "column operator value" in
+//bitmap words [first, last), match[0] being word first; slots is the
+//capacity the caller read before match was copied
+static void colstore_filter(struct colstore *store, unsigned int slots, unsigned int first, unsigned int last,
+			    int column, char operator, int value, unsigned long *match)
+{
+    //capacity is a multiple of BITMAP_WORD_BITS, so the kernels always
+    //read whole words; values past high are zero or belong to slots
+    //whose valid bit wasn't set when match was copied
+    const int *values = LOAD_ACQUIRE(store->values[column]);
+    unsigned int high = LOAD_ACQUIRE(store->high);
+    filter_kernel kernel = filter_select();
+    unsigned int w;
+    if(high > slots){
+	high = slots;
+    }
+    for(w = first; w < last && w * BITMAP_WORD_BITS < high; w++){
+	if(match[w - first] != 0){
+	    match[w - first] &= kernel(values + w * BITMAP_WORD_BITS, operator, value);
+	}
+    }
+}
+
+void strheap_init(struct strheap *heap, struct slab *slab)
+{
+    memset(heap, 0, sizeof(*heap));
+    heap->slab = slab;
+}
+
+static void strheap_grow_buckets(struct strheap *heap)
+{
+    unsigned long size = heap->size ? heap->size * 2 : STRHEAP_INITIAL_SIZE;
+    struct strentry **buckets = calloc(size, sizeof(struct strentry *));
+    struct strentry *entry, *nextentry;
+    unsigned long i;
+    seq_write_begin(&heap->seq);
+    for(i = 0; i < heap->size; i++){
+	for(entry = heap->buckets[i]; entry != NULL; entry = nextentry){
+	    nextentry = entry->hnext;
+	    entry->hnext = buckets[entry->hash & (size - 1)];
+	    buckets[entry->hash & (size - 1)] = entry;
+	}
+    }
+    if(heap->buckets != NULL){
+	ebr_retire(reclaim_array, NULL, heap->buckets);
+    }
+    //size is published after the bigger array, readers load it first
+    STORE_RELEASE(heap->buckets, buckets);
+    STORE_RELEASE(heap->size, size);
+    seq_write_end(&heap->seq);
+}
+
+static struct strentry* strheap_lookup(struct strheap *heap, const char *str, unsigned int hash)
+{
+    struct strentry *entry;
+    unsigned long size = LOAD_ACQUIRE(heap->size);
+    struct strentry **buckets = LOAD_ACQUIRE(heap->buckets);
+    if(size == 0){
+	return NULL;
+    }
+    for(entry = LOAD_ACQUIRE(buckets[hash & (size - 1)]); entry != NULL; entry = LOAD_ACQUIRE(entry->hnext)){
+	if(entry->hash == hash && strcmp(entry->str, str) == 0){
+	    return entry;
+	}
+    }
+    return NULL;
+}
+
+static void reclaim_strentry(void *owner, void *ptr)
+{
+    //the handle is only reused once no reader can hold a row with it
+    struct strheap *heap = owner;
+    struct strentry *entry = ptr;
+    heap->entries[entry->handle] = NULL;
+    heap->freehandles[heap->numfree++] = entry->handle;
+    slab_free(heap->slab, entry, sizeof(struct strentry) + entry->len + 1);
+}
+
+unsigned int strheap_intern(struct strheap *heap, const char *str)
+{
+    //returns the handle of str, adding it if no row holds it yet, or 0 if it can't be added
+    unsigned int hash = hash_key(str);
+    struct strentry *entry = strheap_lookup(heap, str, hash);
+    size_t len;
+    if(entry != NULL){
+	entry->refcount++;
+	return entry->handle;
+    }
+    if(heap->used >= heap->size){
+	strheap_grow_buckets(heap);
+    }
+    len = strlen(str);
+    entry = slab_alloc(heap->slab, sizeof(struct strentry) + len + 1);
+    if(entry == NULL){
+	return 0;
+    }
+    memcpy(entry->str, str, len + 1);
+    entry->len = len;
+    entry->hash = hash;
+    entry->refcount = 1;
+    if(heap->numfree > 0){
+	entry->handle = heap->freehandles[--heap->numfree];
+    }
+    else {
+	if(heap->high == heap->capacity){
+	    unsigned int capacity = heap->capacity ? heap->capacity * 2 : STRHEAP_INITIAL_SIZE;
+	    STORE_RELEASE(heap->entries, array_grow(heap->entries, heap->capacity * sizeof(struct strentry *),
+						    capacity * sizeof(struct strentry *)));
+	    heap->freehandles = realloc(heap->freehandles, capacity * sizeof(unsigned int));
+	    heap->capacity = capacity;
+	}
+	if(heap->high == 0){
+	    heap->entries[heap->high++] = NULL;//handle 0 means no value
+	}
+	entry->handle = heap->high++;
+    }
+    STORE_RELEASE(heap->entries[entry->handle], entry);
+    entry->hnext = heap->buckets[hash & (heap->size - 1)];
+    STORE_RELEASE(heap->buckets[hash & (heap->size - 1)], entry);
+    heap->used++;
+    heap->bytes += sizeof(struct strentry) + len + 1;
+    return entry->handle;
+}
+
+unsigned int strheap_find(struct strheap *heap, const char *str)
+{
+    //returns the handle of str, 0 if no row holds it
+    unsigned int hash = hash_key(str);
+    struct strentry *entry;
+    unsigned long seq;
+    do {
+	seq = seq_read_begin(&heap->seq);
+	entry = strheap_lookup(heap, str, hash);
+    } while(seq_read_retry(&heap->seq, seq));
+    return entry != NULL ? entry->handle : 0;
+}
+
+void strheap_release(struct strheap *heap, unsigned int handle)
+{
+    struct strentry *entry = heap->entries[handle];
+    struct strentry **link;
+    if(--entry->refcount > 0){
+	return;
+    }
+    link = &heap->buckets[entry->hash & (heap->size - 1)];
+    while(*link != entry){
+	link = &(*link)->hnext;
+    }
+    seq_write_begin(&heap->seq);
+    STORE_RELEASE(*link, entry->hnext);
+    seq_write_end(&heap->seq);
+    heap->used--;
+    heap->bytes -= sizeof(struct strentry) + entry->len + 1;
+    ebr_retire(reclaim_strentry, heap, entry);
+}
+
+const char* strheap_get(struct strheap *heap, unsigned int handle)
+{
+    return LOAD_ACQUIRE(LOAD_ACQUIRE(heap->entries)[handle])->str;
+}
+
+void strheap_free(struct strheap *heap)
+{
+    //entries live in the slab and go away with it
+    free(heap->buckets);
+    free(heap->entries);
+    free(heap->freehandles);
+    strheap_init(heap, heap->slab);
+}
+
+//Sets up the secondary indexes the schema asks for
+static void init_indexes(struct citytable *table)
+{
+    int j;
+    memset(table->sorted, 0, sizeof(table->sorted));
+    memset(table->hashed, 0, sizeof(table->hashed));
+    memset(table->bitmaps, 0, sizeof(table->bitmaps));
+    for(j = 0; j < table->schema.numcolumns; j++){
+	if(table->schema.columns[j].index == INDEX_SORTED){
+	    intindex_init(&table->sorted[j], &table->slab);
+	}
+    }
+}
+
+void init_citytable(struct citytable *table, struct column *columns, int numcolumns)
+{
+    build_schema(&table->schema, columns, numcolumns);
+    slab_init(&table->slab);
+    table->head = NULL;
+    table->tail = NULL;
+    table->index.table[0] = NULL;
+    table->index.table[1] = NULL;
+    table->index.size[0] = 0;
+    table->index.size[1] = 0;
+    table->index.used[0] = 0;
+    table->index.used[1] = 0;
+    table->index.rehashidx = -1;
+    table->index.seq = 0;
+    skiplist_init(&table->order, &table->slab);
+    memset(&table->columns, 0, sizeof(table->columns));
+    strheap_init(&table->strings, &table->slab);
+    init_indexes(table);
+    table->memory = 0;
+    table->evicted = 0;
+    table->version = 0;
+    table->cachehits = 0;
+    table->cachemisses = 0;
+    table->stats = NULL;
+}
+
+void free_citytable(struct citytable *table)
+{
+    //records and skiplist nodes all live in the slab
+    int j;
+    free(table->index.table[0]);
+    free(table->index.table[1]);
+    colstore_release(&table->columns);
+    strheap_free(&table->strings);
+    free(table->stats);
+    for(j = 0; j < table->schema.numcolumns; j++){
+	strindex_free(&table->hashed[j]);
+	bitmapindex_free(&table->bitmaps[j]);
+    }
+    slab_release(&table->slab);
+    table->head = NULL;
+    table->tail = NULL;
+    table->index.table[0] = NULL;
+    table->index.table[1] = NULL;
+    table->index.size[0] = 0;
+    table->index.size[1] = 0;
+    table->index.used[0] = 0;
+    table->index.used[1] = 0;
+    table->index.rehashidx = -1;
+    skiplist_init(&table->order, &table->slab);
+    memset(&table->columns, 0, sizeof(table->columns));
+    init_indexes(table);
+}
+
+//Moves one non-empty bucket from table[0] to table[1]
+static void cityhash_rehash_step(struct cityhash *index)
+{
+    int empty_visits = CITYHASH_EMPTY_VISITS;
+    struct city *node;
+    struct city *nextnode;
+    unsigned long slot;
+
+    if(index->rehashidx == -1){
+	return;
+    }
+    while(index->table[0][index->rehashidx] == NULL){
+	index->rehashidx++;
+	if((unsigned long)index->rehashidx >= index->size[0] || --empty_visits == 0){
+	    break;
+	}
+    }
+    if((unsigned long)index->rehashidx < index->size[0]){
+	node = index->table[0][index->rehashidx];
+	while(node != NULL){
+	    nextnode = node->hnext;
+	    slot = node->hash & (index->size[1] - 1);
+	    STORE_RELEASE(node->hnext, index->table[1][slot]);
+	    STORE_RELEASE(index->table[1][slot], node);
+	    index->used[0]--;
+	    index->used[1]++;
+	    node = nextnode;
+	}
+	STORE_RELEASE(index->table[0][index->rehashidx], NULL);
+	index->rehashidx++;
+    }
+    if((unsigned long)index->rehashidx >= index->size[0]){
+	//rehash finished, table[1] becomes the main table; readers load a
+	//size before its table so they never index past the array they see
+	ebr_retire(reclaim_array, NULL, index->table[0]);
+	STORE_RELEASE(index->table[0], index->table[1]);
+	STORE_RELEASE(index->size[0], index->size[1]);
+	index->used[0] = index->used[1];
+	STORE_RELEASE(index->size[1], 0);
+	STORE_RELEASE(index->table[1], NULL);
+	index->used[1] = 0;
+	index->rehashidx = -1;
+    }
+}
+
+static void cityhash_add(struct cityhash *index, struct city *node)
+{
+    int t = 0;
+    unsigned long slot;
+
+    seq_write_begin(&index->seq);
+    if(index->size[0] == 0){
+	STORE_RELEASE(index->table[0], calloc(CITYHASH_INITIAL_SIZE, sizeof(struct city *)));
+	STORE_RELEASE(index->size[0], CITYHASH_INITIAL_SIZE);
+    }
+    else if(index->rehashidx == -1 && index->used[0] >= index->size[0]){
+	//start growing, the buckets are moved over the following writes
+	STORE_RELEASE(index->table[1], calloc(index->size[0] * 2, sizeof(struct city *)));
+	STORE_RELEASE(index->size[1], index->size[0] * 2);
+	index->used[1] = 0;
+	index->rehashidx = 0;
+    }
+    cityhash_rehash_step(index);
+    if(index->rehashidx != -1){
+	t = 1;
+    }
+    slot = node->hash & (index->size[t] - 1);
+    node->hnext = index->table[t][slot];
+    STORE_RELEASE(index->table[t][slot], node);
+    index->used[t]++;
+    seq_write_end(&index->seq);
+}
+
+static struct city* cityhash_lookup(struct cityhash *index, const char *name, unsigned int hash)
+{
+    int t;
+    unsigned long size;
+    struct city **buckets;
+    struct city *node;
+
+    for(t = 0; t <= 1; t++){
+	size = LOAD_ACQUIRE(index->size[t]);
+	buckets = LOAD_ACQUIRE(index->table[t]);
+	if(size == 0 || buckets == NULL){
+	    continue;
+	}
+	node = LOAD_ACQUIRE(buckets[hash & (size - 1)]);
+	while(node != NULL){
+	    if(node->hash == hash && strcmp(node->name, name) == 0){
+		return node;
+	    }
+	    node = LOAD_ACQUIRE(node->hnext);
+	}
+    }
+    return NULL;
+}
+
+static struct city* cityhash_find(struct cityhash *index, const char *name, unsigned int hash)
+{
+    //a writer moving nodes between tables can hide one, so retry around it
+    struct city *node;
+    unsigned long seq;
+    do {
+	seq = seq_read_begin(&index->seq);
+	node = cityhash_lookup(index, name, hash);
+    } while(seq_read_retry(&index->seq, seq));
+    return node;
+}
+
+static void cityhash_remove(struct cityhash *index, struct city *target)
+{
+    int t;
+    struct city **link;
+
+    seq_write_begin(&index->seq);
+    cityhash_rehash_step(index);
+    for(t = 0; t <= 1; t++){
+	if(index->size[t] == 0){
+	    continue;
+	}
+	link = &index->table[t][target->hash & (index->size[t] - 1)];
+	while(*link != NULL){
+	    if(*link == target){
+		STORE_RELEASE(*link, target->hnext);
+		index->used[t]--;
+		seq_write_end(&index->seq);
+		return;
+	    }
+	    link = &(*link)->hnext;
+	}
+    }
+    seq_write_end(&index->seq);
+}
+
+//Puts new_node in target's place in its bucket chain
+static void cityhash_replace(struct cityhash *index, struct city *target, struct city *new_node)
+{
+    int t;
+    struct city **link;
+
+    for(t = 0; t <= 1; t++){
+	if(index->size[t] == 0){
+	    continue;
+	}
+	link = &index->table[t][target->hash & (index->size[t] - 1)];
+	while(*link != NULL){
+	    if(*link == target){
+		new_node->hnext = target->hnext;
+		STORE_RELEASE(*link, new_node);
+		return;
+	    }
+	    link = &(*link)->hnext;
+	}
+    }
+}
+
+static void reclaim_city(void *owner, void *ptr)
+{
+    struct citytable *table = owner;
+    slab_free(&table->slab, ptr, sizeof(struct city) + table->schema.rowsize);
+}
+
+static unsigned long access_clock;//ticks on every record read or write
+
+//Recounts the bytes of table, after every insert, modify and delete
+static void table_account(struct citytable *table)
+{
+    struct colstore *store = &table->columns;
+    int j;
+    table->memory = table->order.length * (sizeof(struct city) + table->schema.rowsize)
+	+ table->order.bytes + table->strings.bytes
+	+ (table->index.size[0] + table->index.size[1]) * sizeof(struct city *)
+	+ table->strings.size * sizeof(struct strentry *)
+	+ table->strings.capacity * (sizeof(struct strentry *) + sizeof(unsigned int))
+	+ store->capacity * (table->schema.numcolumns * sizeof(int) + sizeof(struct city *) + sizeof(unsigned int))
+	+ store->capacity / 8 + COLSTORE_ZONES(store->capacity) * table->schema.numcolumns * 2 * sizeof(int);
+    for(j = 0; j < table->schema.numcolumns; j++){
+	table->memory += table->sorted[j].bytes + table->hashed[j].bytes + table->bitmaps[j].bytes;
+    }
+}
+
+//Adds (remove false) or removes the index entries of a record
+static void index_row(struct citytable *table, struct city *node, bool remove)
+{
+    int j;
+    for(j = 0; j < table->schema.numcolumns; j++){
+	struct schemacolumn *column = &table->schema.columns[j];
+	if(column->index == INDEX_SORTED){
+	    if(remove){
+		intindex_delete(&table->sorted[j], row_int(node->row, column), node->slot);
+	    }
+	    else {
+		intindex_insert(&table->sorted[j], row_int(node->row, column), node->slot);
+	    }
+	}
+	else if(column->index == INDEX_HASH){
+	    if(remove){
+		strindex_remove(&table->hashed[j], row_handle(node->row, column), node->slot);
+	    }
+	    else {
+		strindex_add(&table->hashed[j], row_handle(node->row, column), node->slot);
+	    }
+	}
+	else if(column->index == INDEX_BITMAP){
+	    if(remove){
+		bitmapindex_remove(&table->bitmaps[j], row_handle(node->row, column), node->slot);
+	    }
+	    else {
+		bitmapindex_add(&table->bitmaps[j], row_handle(node->row, column), node->slot);
+	    }
+	}
+    }
+}
+
+//Moves the index entries of the columns a modify changed
+static void index_update(struct citytable *table, struct city *old, struct city *node)
+{
+    int j;
+    for(j = 0; j < table->schema.numcolumns; j++){
+	struct schemacolumn *column = &table->schema.columns[j];
+	if(column->index == INDEX_SORTED && row_int(old->row, column) != row_int(node->row, column)){
+	    intindex_delete(&table->sorted[j], row_int(old->row, column), old->slot);
+	    intindex_insert(&table->sorted[j], row_int(node->row, column), node->slot);
+	}
+	else if(column->index == INDEX_HASH && row_handle(old->row, column) != row_handle(node->row, column)){
+	    strindex_remove(&table->hashed[j], row_handle(old->row, column), old->slot);
+	    strindex_add(&table->hashed[j], row_handle(node->row, column), node->slot);
+	}
+	else if(column->index == INDEX_BITMAP && row_handle(old->row, column) != row_handle(node->row, column)){
+	    bitmapindex_remove(&table->bitmaps[j], row_handle(old->row, column), old->slot);
+	    bitmapindex_add(&table->bitmaps[j], row_handle(node->row, column), node->slot);
+	}
+    }
+}
+
+//Swaps the decoded string values of a row for strheap handles
+static int row_intern(struct citytable *table, char *row, char strvals[][MAX_VALUE_LEN])
+{
+    //returns -1, holding none of the strings, if one can't be added
+    int j;
+    unsigned int handle;
+    for(j = 0; j < table->schema.numcolumns; j++){
+	struct schemacolumn *column = &table->schema.columns[j];
+	if(column->type == COLUMN_STR){
+	    handle = strheap_intern(&table->strings, strvals[j]);
+	    if(handle == 0){
+		while(--j >= 0){
+		    if(table->schema.columns[j].type == COLUMN_STR){
+			strheap_release(&table->strings, row_handle(row, &table->schema.columns[j]));
+		    }
+		}
+		return -1;
+	    }
+	    *(unsigned int *)(row + column->offset) = handle;
+	}
+    }
+    return 0;
+}
+
+static void row_release(struct citytable *table, char *row)
+{
+    int j;
+    for(j = 0; j < table->schema.numcolumns; j++){
+	struct schemacolumn *column = &table->schema.columns[j];
+	if(column->type == COLUMN_STR){
+	    strheap_release(&table->strings, row_handle(row, column));
+	}
+    }
+}
+
+struct city* create_city(struct citytable *table, char* new_name, char *codedvalue)
+{
+    char row[MAX_ROW_SIZE];
+    char strvals[MAX_COLUMNS_PER_TABLE][MAX_VALUE_LEN];
+    struct city* new_city;
+    //printf("codedvalue: %s\n", codedvalue);
+    if(decode_value(&table->schema, row, strvals, codedvalue) != table->schema.numcolumns){
+	return NULL;
+    }
+    new_city = slab_alloc(&table->slab, sizeof(struct city) + table->schema.rowsize);
+    if(new_city == NULL){
+	return NULL;
+    }
+    if(row_intern(table, row, strvals) != 0){
+	slab_free(&table->slab, new_city, sizeof(struct city) + table->schema.rowsize);
+	return NULL;
+    }
+    new_city->counter = 1;
+    new_city->atime = __atomic_add_fetch(&access_clock, 1, __ATOMIC_RELAXED);
+    new_city->mtime = new_city->atime;
+    strncpy(new_city->name, new_name, sizeof(new_city->name));
+    new_city->name[MAX_KEY_LEN] = '\0';
+    new_city->hash = hash_key(new_city->name);
+    memcpy(new_city->row, row, table->schema.rowsize);
+    new_city->next = NULL;
+    new_city->prev = NULL;
+    new_city->hnext = NULL;
+    return new_city;
+}
+
+struct city* insert_city(struct citytable *table, char *new_key, char *value_encoded)
+{
+    //printf("value_encoded: %s\n", value_encoded);
+    struct city* new_city = create_city(table, new_key, value_encoded);
+    if (new_city == NULL){
+	return NULL;//value doesn't match the schema, or out of memory
+    }
+    //the only step that can fail, so it goes before the record is linked anywhere
+    if (skiplist_insert(&table->order, new_city) != 0){
+	row_release(table, new_city->row);
+	slab_free(&table->slab, new_city, sizeof(struct city) + table->schema.rowsize);
+	return NULL;
+    }
+    if (table->tail != NULL){
+	new_city->prev = table->tail;
+	STORE_RELEASE(table->tail->next, new_city);
+    }
+    else {
+	STORE_RELEASE(table->head, new_city);
+    }
+    table->tail = new_city;
+    cityhash_add(&table->index, new_city);
+    colstore_add(&table->columns, &table->schema, new_city);
+    index_row(table, new_city, false);
+    table_account(table);
+    __atomic_add_fetch(&table->version, 1, __ATOMIC_RELEASE);//after the change, see querycache_get()
+    stats_refresh(table);
+    return new_city;
+}
+
+struct city* modify_city(struct citytable *table, char *name, char *value_encoded)
+{
+    char row[MAX_ROW_SIZE];
+    char strvals[MAX_COLUMNS_PER_TABLE][MAX_VALUE_LEN];
+    struct city *tempnode = find_city(table, name);
+    struct city *new_city;
+    if(tempnode == NULL){
+	return NULL;
+    }
+    if(decode_value(&table->schema, row, strvals, value_encoded) != table->schema.numcolumns){
+	return NULL;//value doesn't match the schema
+    }
+    //readers may be inside the old row, so it's swapped for a copy and
+    //retired; the new values are interned first so unchanged ones keep their entry
+    new_city = slab_alloc(&table->slab, sizeof(struct city) + table->schema.rowsize);
+    if(new_city == NULL){
+	return NULL;
+    }
+    if(row_intern(table, row, strvals) != 0){
+	slab_free(&table->slab, new_city, sizeof(struct city) + table->schema.rowsize);
+	return NULL;
+    }
+    memcpy(new_city, tempnode, sizeof(struct city));
+    memcpy(new_city->row, row, table->schema.rowsize);
+    new_city->counter++;
+    new_city->atime = __atomic_add_fetch(&access_clock, 1, __ATOMIC_RELAXED);
+    new_city->mtime = new_city->atime;
+    cityhash_replace(&table->index, tempnode, new_city);
+    skiplist_replace(&table->order, tempnode, new_city);
+    if(new_city->prev != NULL){
+	STORE_RELEASE(new_city->prev->next, new_city);
+    }
+    else {
+	STORE_RELEASE(table->head, new_city);
+    }
+    if(new_city->next != NULL){
+	new_city->next->prev = new_city;
+    }
+    else {
+	table->tail = new_city;
+    }
+    index_update(table, tempnode, new_city);
+    colstore_sync(&table->columns, &table->schema, new_city);
+    STORE_RELEASE(table->columns.rows[new_city->slot], new_city);
+    row_release(table, tempnode->row);
+    ebr_retire(reclaim_city, table, tempnode);
+    table_account(table);
+    __atomic_add_fetch(&table->version, 1, __ATOMIC_RELEASE);
+    stats_refresh(table);
+    return new_city;
+}
+
+int delete_city(struct citytable *table, char* name)
+{
+    struct city *this = find_city(table, name);
+
+    if (this == NULL){
+	printf("The city is not found\n");
+	return -1;
+    }
+    cityhash_remove(&table->index, this);
+    skiplist_delete(&table->order, this);
+    index_row(table, this, true);
+    colstore_remove(&table->columns, this);
+    row_release(table, this->row);
+    if (this->prev != NULL){
+	STORE_RELEASE(this->prev->next, this->next);
+    }
+    else {
+	STORE_RELEASE(table->head, this->next);
+    }
+    if (this->next != NULL){
+	this->next->prev = this->prev;
+    }
+    else {
+	table->tail = this->prev;
+    }
+    ebr_retire(reclaim_city, table, this);
+    table_account(table);
+    __atomic_add_fetch(&table->version, 1, __ATOMIC_RELEASE);
+    stats_refresh(table);
+    return 0;
+}
+
+struct city* find_city(struct citytable *table, char* name)
+{
+    struct city *node;
+    if (LOAD_ACQUIRE(table->head) == NULL)
+    {
+	return NULL;
+    }
+    node = cityhash_find(&table->index, name, hash_key(name));
+    if (node != NULL){
+	//readers race on this, a lost update only ages the record a little
+	__atomic_store_n(&node->atime, __atomic_add_fetch(&access_clock, 1, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    }
+    return node;
+}
+
+//Best of a few random records of table to evict, NULL if none but keep
+static struct city* evict_sample(struct citytable *table, int policy, struct city *keep)
+{
+    struct colstore *store = &table->columns;
+    struct city *best = NULL;
+    struct city *node;
+    int samples = policy == EVICT_RANDOM ? 1 : EVICTION_SAMPLES;
+    int tries;
+    if(store->high == 0){
+	return NULL;
+    }
+    //freed slots are skipped, so allow some misses before giving up
+    for(tries = 0; tries < EVICTION_SAMPLES * 4 && samples > 0; tries++){
+	node = store->rows[rand() % store->high];
+	if(node == NULL || node == keep){
+	    continue;
+	}
+	samples--;
+	if(best == NULL
+	   || (policy == EVICT_LRU && node->atime < best->atime)
+	   || (policy == EVICT_TTL && node->mtime < best->mtime)){
+	    best = node;
+	}
+    }
+    return best;
+}
+
+int evict_cities(struct config_params *params, struct citytable *tables, int index, struct city *keep)
+{
+    struct city *victim;
+    unsigned long total;
+    int evicted = 0;
+    int target, k;
+    while(evicted < EVICTION_PER_SET){
+	target = -1;
+	if(params->memory_caps[index] > 0 && tables[index].memory > params->memory_caps[index]){
+	    target = index;
+	}
+	else if(params->max_memory > 0){
+	    total = 0;
+	    for(k = 0; k < params->num_tables; k++){
+		total += tables[k].memory;
+		if(target == -1 || tables[k].memory > tables[target].memory){
+		    target = k;
+		}
+	    }
+	    if(total <= params->max_memory){
+		target = -1;
+	    }
+	}
+	if(target == -1){
+	    break;
+	}
+	victim = evict_sample(&tables[target], params->eviction, keep);
+	if(victim == NULL){
+	    break;
+	}
+	delete_city(&tables[target], victim->name);
+	tables[target].evicted++;
+	evicted++;
+    }
+    return evicted;
+}
+
+void keylist_init(struct keylist *list)
+{
+    list->keys = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+void keylist_add(struct keylist *list, const char *key)
+{
+    if(list->count == list->capacity){
+	list->capacity = list->capacity ? list->capacity * 2 : 64;
+	list->keys = realloc(list->keys, list->capacity * sizeof(*list->keys));
+    }
+    strncpy(list->keys[list->count], key, sizeof(list->keys[0]));
+    list->keys[list->count][MAX_KEY_LEN] = '\0';
+    list->count++;
+}
+
+void keylist_free(struct keylist *list)
+{
+    free(list->keys);
+    keylist_init(list);
+}
+
+void skiplist_init(struct skiplist *list, struct slab *slab)
+{
+    int i;
+    list->slab = slab;
+    list->header = slab_alloc(slab, sizeof(struct skipnode) + SKIPLIST_MAXLEVEL * sizeof(struct skipnode *));
+    list->header->city = NULL;
+    list->header->level = SKIPLIST_MAXLEVEL;
+    for(i = 0; i < SKIPLIST_MAXLEVEL; i++){
+	list->header->forward[i] = NULL;
+    }
+    list->level = 1;
+    list->length = 0;
+    list->bytes = 0;
+}
+
+static int skiplist_random_level(void)
+{
+    //each level is kept with probability 1/4
+    int level = 1;
+    while(level < SKIPLIST_MAXLEVEL && (rand() & 3) == 0){
+	level++;
+    }
+    return level;
+}
+
+//Fills update[] with the last node before name on every level
+static struct skipnode* skiplist_predecessors(struct skiplist *list, const char *name, struct skipnode **update)
+{
+    struct skipnode *x = list->header;
+    int i;
+    for(i = LOAD_ACQUIRE(list->level) - 1; i >= 0; i--){
+	struct skipnode *next;
+	while((next = LOAD_ACQUIRE(x->forward[i])) != NULL && strcmp(LOAD_ACQUIRE(next->city)->name, name) < 0){
+	    x = next;
+	}
+	if(update != NULL){
+	    update[i] = x;
+	}
+    }
+    return x;
+}
+
+int skiplist_insert(struct skiplist *list, struct city *node)
+{
+    struct skipnode *update[SKIPLIST_MAXLEVEL];
+    struct skipnode *x;
+    int level = skiplist_random_level();
+    int i;
+
+    x = slab_alloc(list->slab, sizeof(struct skipnode) + level * sizeof(struct skipnode *));
+    if(x == NULL){
+	return -1;//the list is unchanged
+    }
+    skiplist_predecessors(list, node->name, update);
+    if(level > list->level){
+	for(i = list->level; i < level; i++){
+	    update[i] = list->header;
+	}
+	STORE_RELEASE(list->level, level);
+    }
+    x->city = node;
+    x->level = level;
+    for(i = 0; i < level; i++){
+	x->forward[i] = update[i]->forward[i];
+	STORE_RELEASE(update[i]->forward[i], x);
+    }
+    list->length++;
+    list->bytes += sizeof(struct skipnode) + level * sizeof(struct skipnode *);
+    return 0;
+}
+
+static void reclaim_skipnode(void *owner, void *ptr)
+{
+    struct skiplist *list = owner;
+    struct skipnode *x = ptr;
+    slab_free(list->slab, x, sizeof(struct skipnode) + x->level * sizeof(struct skipnode *));
+}
+
+void skiplist_delete(struct skiplist *list, struct city *node)
+{
+    struct skipnode *update[SKIPLIST_MAXLEVEL];
+    struct skipnode *x;
+    int i;
+
+    x = skiplist_predecessors(list, node->name, update)->forward[0];
+    if(x == NULL || x->city != node){
+	return;
+    }
+    for(i = 0; i < x->level; i++){
+	STORE_RELEASE(update[i]->forward[i], x->forward[i]);
+    }
+    while(list->level > 1 && list->header->forward[list->level - 1] == NULL){
+	STORE_RELEASE(list->level, list->level - 1);
+    }
+    list->bytes -= sizeof(struct skipnode) + x->level * sizeof(struct skipnode *);
+    ebr_retire(reclaim_skipnode, list, x);
+    list->length--;
+}
+
+void skiplist_replace(struct skiplist *list, struct city *node, struct city *new_node)
+{
+    struct skipnode *x = skiplist_predecessors(list, node->name, NULL)->forward[0];
+    if(x != NULL && x->city == node){
+	STORE_RELEASE(x->city, new_node);
+    }
+}
+
+struct skipnode* skiplist_seek(struct skiplist *list, const char *name)
+{
+    //first node whose key is >= name
+    return LOAD_ACQUIRE(skiplist_predecessors(list, name, NULL)->forward[0]);
+}
+
+void intindex_init(struct intindex *index, struct slab *slab)
+{
+    int i;
+    index->slab = slab;
+    index->header = slab_alloc(slab, sizeof(struct intnode) + SKIPLIST_MAXLEVEL * sizeof(struct intnode *));
+    index->header->level = SKIPLIST_MAXLEVEL;
+    for(i = 0; i < SKIPLIST_MAXLEVEL; i++){
+	index->header->forward[i] = NULL;
+    }
+    index->level = 1;
+    index->length = 0;
+    index->bytes = 0;
+}
+
+//Entries are ordered by value, then slot, so every pair is unique
+static int intnode_before(struct intnode *x, int value, unsigned int slot)
+{
+    return x->value < value || (x->value == value && x->slot < slot);
+}
+
+static struct intnode* intindex_predecessors(struct intindex *index, int value, unsigned int slot, struct intnode **update)
+{
+    struct intnode *x = index->header;
+    struct intnode *next;
+    int i;
+    for(i = LOAD_ACQUIRE(index->level) - 1; i >= 0; i--){
+	while((next = LOAD_ACQUIRE(x->forward[i])) != NULL && intnode_before(next, value, slot)){
+	    x = next;
+	}
+	if(update != NULL){
+	    update[i] = x;
+	}
+    }
+    return x;
+}
+
+void intindex_insert(struct intindex *index, int value, unsigned int slot)
+{
+    struct intnode *update[SKIPLIST_MAXLEVEL];
+    struct intnode *x;
+    int level = skiplist_random_level();
+    int i;
+
+    intindex_predecessors(index, value, slot, update);
+    if(level > index->level){
+	for(i = index->level; i < level; i++){
+	    update[i] = index->header;
+	}
+	STORE_RELEASE(index->level, level);
+    }
+    x = slab_alloc(index->slab, sizeof(struct intnode) + level * sizeof(struct intnode *));
+    x->value = value;
+    x->slot = slot;
+    x->level = level;
+    for(i = 0; i < level; i++){
+	x->forward[i] = update[i]->forward[i];
+	STORE_RELEASE(update[i]->forward[i], x);
+    }
+    index->length++;
+    index->bytes += sizeof(struct intnode) + level * sizeof(struct intnode *);
+}
+
+static void reclaim_intnode(void *owner, void *ptr)
+{
+    struct intindex *index = owner;
+    struct intnode *x = ptr;
+    slab_free(index->slab, x, sizeof(struct intnode) + x->level * sizeof(struct intnode *));
+}
+
+void intindex_delete(struct intindex *index, int value, unsigned int slot)
+{
+    struct intnode *update[SKIPLIST_MAXLEVEL];
+    struct intnode *x;
+    int i;
+
+    x = intindex_predecessors(index, value, slot, update)->forward[0];
+    if(x == NULL || x->value != value || x->slot != slot){
+	return;
+    }
+    for(i = 0; i < x->level; i++){
+	STORE_RELEASE(update[i]->forward[i], x->forward[i]);
+    }
+    while(index->level > 1 && index->header->forward[index->level - 1] == NULL){
+	STORE_RELEASE(index->level, index->level - 1);
+    }
+    index->bytes -= sizeof(struct intnode) + x->level * sizeof(struct intnode *);
+    ebr_retire(reclaim_intnode, index, x);
+    index->length--;
+}
+
+struct intnode* intindex_seek(struct intindex *index, int value)
+{
+    //first entry whose value is >= value
+    return LOAD_ACQUIRE(intindex_predecessors(index, value, 0, NULL)->forward[0]);
+}
+
+void strindex_add(struct strindex *index, unsigned int handle, unsigned int slot)
+{
+    //arrays readers follow are grown by copy, count is published last
+    struct postlist *list;
+    unsigned int capacity;
+    if(handle >= index->numlists){
+	capacity = index->numlists ? index->numlists * 2 : STRHEAP_INITIAL_SIZE;
+	while(capacity <= handle){
+	    capacity *= 2;
+	}
+	STORE_RELEASE(index->lists, array_grow(index->lists, index->numlists * sizeof(struct postlist),
+					       capacity * sizeof(struct postlist)));
+	index->bytes += (capacity - index->numlists) * sizeof(struct postlist);
+	STORE_RELEASE(index->numlists, capacity);
+    }
+    if(slot >= index->numpos){
+	capacity = index->numpos ? index->numpos * 2 : COLSTORE_INITIAL_SLOTS;
+	while(capacity <= slot){
+	    capacity *= 2;
+	}
+	index->pos = realloc(index->pos, capacity * sizeof(unsigned int));
+	index->bytes += (capacity - index->numpos) * sizeof(unsigned int);
+	index->numpos = capacity;
+    }
+    list = &index->lists[handle];
+    if(list->count == list->capacity){
+	capacity = list->capacity ? list->capacity * 2 : 4;
+	STORE_RELEASE(list->slots, array_grow(list->slots, list->capacity * sizeof(unsigned int),
+					      capacity * sizeof(unsigned int)));
+	index->bytes += (capacity - list->capacity) * sizeof(unsigned int);
+	list->capacity = capacity;
+    }
+    list->slots[list->count] = slot;
+    index->pos[slot] = list->count;
+    STORE_RELEASE(list->count, list->count + 1);
+}
+
+void strindex_remove(struct strindex *index, unsigned int handle, unsigned int slot)
+{
+    //the last entry fills the hole, readers that loaded the old count
+    //still find it at the end
+    struct postlist *list = &index->lists[handle];
+    unsigned int at = index->pos[slot];
+    unsigned int last = list->slots[list->count - 1];
+    __atomic_store_n(&list->slots[at], last, __ATOMIC_RELEASE);
+    index->pos[last] = at;
+    STORE_RELEASE(list->count, list->count - 1);
+    if(list->count == 0){
+	//the handle may go to another value, drop the array with it
+	ebr_retire(reclaim_array, NULL, list->slots);
+	index->bytes -= list->capacity * sizeof(unsigned int);
+	STORE_RELEASE(list->slots, NULL);
+	list->capacity = 0;
+    }
+}
+
+void strindex_free(struct strindex *index)
+{
+    unsigned int h;
+    for(h = 0; h < index->numlists; h++){
+	free(index->lists[h].slots);
+    }
+    free(index->lists);
+    free(index->pos);
+    memset(index, 0, sizeof(*index));
+}
+
+static size_t slotarray_size(unsigned int count)
+{
+    return sizeof(struct slotarray) + count * sizeof(unsigned short);
+}
+
+void bitmapindex_add(struct bitmapindex *index, unsigned int handle, unsigned int slot)
+{
+    //arrays readers follow are replaced by copies, bitmap words are
+    //set in place
+    struct valuebitmap *value;
+    struct container *block;
+    struct slotarray *array, *copy;
+    unsigned long *bits;
+    unsigned int capacity, count, k;
+    unsigned int b = slot / CONTAINER_SLOTS;
+    unsigned short low = slot % CONTAINER_SLOTS;
+    if(handle >= index->numvalues){
+	capacity = index->numvalues ? index->numvalues * 2 : STRHEAP_INITIAL_SIZE;
+	while(capacity <= handle){
+	    capacity *= 2;
+	}
+	STORE_RELEASE(index->values, array_grow(index->values, index->numvalues * sizeof(struct valuebitmap),
+						capacity * sizeof(struct valuebitmap)));
+	index->bytes += (capacity - index->numvalues) * sizeof(struct valuebitmap);
+	STORE_RELEASE(index->numvalues, capacity);
+    }
+    value = &index->values[handle];
+    if(b >= value->numblocks){
+	STORE_RELEASE(value->blocks, array_grow(value->blocks, value->numblocks * sizeof(struct container),
+						(b + 1) * sizeof(struct container)));
+	index->bytes += (b + 1 - value->numblocks) * sizeof(struct container);
+	STORE_RELEASE(value->numblocks, b + 1);
+    }
+    block = &value->blocks[b];
+    array = block->array;
+    count = array != NULL ? array->count : 0;
+    if(block->bits != NULL){
+	__atomic_fetch_or(&block->bits[low / BITMAP_WORD_BITS], 1UL << (low % BITMAP_WORD_BITS), __ATOMIC_RELEASE);
+    }
+    else if(count == CONTAINER_ARRAY_MAX){
+	//past here the array takes more room than the bitmap
+	bits = calloc(CONTAINER_WORDS, sizeof(unsigned long));
+	for(k = 0; k < count; k++){
+	    bits[array->low[k] / BITMAP_WORD_BITS] |= 1UL << (array->low[k] % BITMAP_WORD_BITS);
+	}
+	bits[low / BITMAP_WORD_BITS] |= 1UL << (low % BITMAP_WORD_BITS);
+	STORE_RELEASE(block->bits, bits);
+	ebr_retire(reclaim_array, NULL, array);
+	STORE_RELEASE(block->array, NULL);
+	index->bytes += CONTAINER_WORDS * sizeof(unsigned long) - slotarray_size(count);
+    }
+    else {
+	copy = malloc(slotarray_size(count + 1));
+	for(k = 0; k < count && array->low[k] < low; k++);
+	if(k > 0){
+	    memcpy(copy->low, array->low, k * sizeof(unsigned short));
+	}
+	copy->low[k] = low;
+	if(k < count){
+	    memcpy(copy->low + k + 1, array->low + k, (count - k) * sizeof(unsigned short));
+	}
+	copy->count = count + 1;
+	STORE_RELEASE(block->array, copy);
+	if(array != NULL){
+	    ebr_retire(reclaim_array, NULL, array);
+	}
+	index->bytes += slotarray_size(count + 1) - (array != NULL ? slotarray_size(count) : 0);
+    }
+    STORE_RELEASE(value->count, value->count + 1);
+}
+
+void bitmapindex_remove(struct bitmapindex *index, unsigned int handle, unsigned int slot)
+{
+    struct valuebitmap *value = &index->values[handle];
+    struct container *block = &value->blocks[slot / CONTAINER_SLOTS];
+    struct slotarray *array = block->array;
+    struct slotarray *copy = NULL;
+    unsigned short low = slot % CONTAINER_SLOTS;
+    unsigned int numblocks = value->numblocks;
+    unsigned int b, k;
+    if(block->bits != NULL){
+	__atomic_fetch_and(&block->bits[low / BITMAP_WORD_BITS], ~(1UL << (low % BITMAP_WORD_BITS)), __ATOMIC_RELEASE);
+    }
+    else if(array != NULL){
+	for(k = 0; k < array->count && array->low[k] != low; k++);
+	if(k == array->count){
+	    return;
+	}
+	if(array->count > 1){
+	    copy = malloc(slotarray_size(array->count - 1));
+	    memcpy(copy->low, array->low, k * sizeof(unsigned short));
+	    memcpy(copy->low + k, array->low + k + 1, (array->count - k - 1) * sizeof(unsigned short));
+	    copy->count = array->count - 1;
+	    index->bytes += slotarray_size(copy->count);
+	}
+	STORE_RELEASE(block->array, copy);
+	ebr_retire(reclaim_array, NULL, array);
+	index->bytes -= slotarray_size(array->count);
+    }
+    STORE_RELEASE(value->count, value->count - 1);
+    if(value->count == 0){
+	//the handle may go to another value, drop the blocks with it;
+	//readers that loaded the old numblocks find blocks NULL
+	STORE_RELEASE(value->numblocks, 0);
+	for(b = 0; b < numblocks; b++){
+	    if(value->blocks[b].bits != NULL){
+		ebr_retire(reclaim_array, NULL, value->blocks[b].bits);
+		index->bytes -= CONTAINER_WORDS * sizeof(unsigned long);
+	    }
+	    if(value->blocks[b].array != NULL){
+		ebr_retire(reclaim_array, NULL, value->blocks[b].array);
+		index->bytes -= slotarray_size(value->blocks[b].array->count);
+	    }
+	}
+	ebr_retire(reclaim_array, NULL, value->blocks);
+	index->bytes -= numblocks * sizeof(struct container);
+	STORE_RELEASE(value->blocks, NULL);
+    }
+}
+
+void bitmapindex_free(struct bitmapindex *index)
+{
+    unsigned int h, b;
+    for(h = 0; h < index->numvalues; h++){
+	for(b = 0; b < index->values[h].numblocks; b++){
+	    free(index->values[h].blocks[b].array);
+	    free(index->values[h].blocks[b].bits);
+	}
+	free(index->values[h].blocks);
+    }
+    free(index->values);
+    memset(index, 0, sizeof(*index));
+}
+
+void print_city(struct citytable *table, struct city* this_city)
+{
+    struct schema *schema = &table->schema;
+    if (this_city != NULL){
+	int i = 0; //loop counter
+	while(i < schema->numcolumns){
+	    if(schema->columns[i].type == COLUMN_STR){
+		printf("%s \n", strheap_get(&table->strings, row_handle(this_city->row, &schema->columns[i])));
+	    }
+	    else if(schema->columns[i].type == COLUMN_FLOAT){
+		printf("%.9g \n", key_float(row_int(this_city->row, &schema->columns[i])));
+	    }
+	    else {
+		printf("%d \n", row_int(this_city->row, &schema->columns[i]));
+	    }
+	    i++;
+	}
+    }
+    else {
+	printf("the city is NULL\n");
+    }
+}
+
+void print_list(struct citytable *table, struct city* head)
+{
+    if (head != NULL){
+	while (head != NULL){
+	    print_city(table, head);
+	    head = head->next;
+	}
+    }
+    else {
+	printf("The list is empty\n");
+    }
+    
+}
+
+//Get function without overflowing target array
+void sget(char *s, int arraylength)
+{
+    int i=0;
+    char c;
+    while(i < arraylength-1 && (c=getchar())!='\n')
+	{   
+	    if(c!=127)
+		{
+		    s[i]=c;
+		    i++;
+		}
+	}
+    s[i]='\0';
+} 
+
+
+int config_reserve(struct config_params *params, int table, int column)
+{
+    //called by the config parser before it writes column [table][column]
+    int capacity;
+    if (column >= MAX_COLUMNS_PER_TABLE){
+	return -1;
+    }
+    if (params->max_tables > 0 && table >= params->max_tables){
+	return -1;
+    }
+    if (table < params->table_capacity){
+	return 0;
+    }
+    capacity = params->table_capacity ? params->table_capacity * 2 : 16;
+    while (capacity <= table){
+	capacity *= 2;
+    }
+    params->tablelist = realloc(params->tablelist, capacity * sizeof(*params->tablelist));
+    params->num_columns = realloc(params->num_columns, capacity * sizeof(*params->num_columns));
+    params->columnlist = realloc(params->columnlist, capacity * sizeof(*params->columnlist));
+    params->memory_caps = realloc(params->memory_caps, capacity * sizeof(*params->memory_caps));
+    memset(params->tablelist + params->table_capacity, 0, (capacity - params->table_capacity) * sizeof(*params->tablelist));
+    memset(params->num_columns + params->table_capacity, 0, (capacity - params->table_capacity) * sizeof(*params->num_columns));
+    memset(params->columnlist + params->table_capacity, 0, (capacity - params->table_capacity) * sizeof(*params->columnlist));
+    memset(params->memory_caps + params->table_capacity, 0, (capacity - params->table_capacity) * sizeof(*params->memory_caps));
+    params->table_capacity = capacity;
+    return 0;
+}
+
+void build_tableindex(struct config_params *params)
+{
+    struct tableindex *lookup = &params->tableindex;
+    unsigned int hash, bucket;
+    int i;
+    lookup->size = TABLEINDEX_MIN_SIZE;
+    while (lookup->size < 2 * (unsigned int)params->num_tables){
+	lookup->size *= 2;
+    }
+    lookup->slot = calloc(lookup->size, sizeof(int));
+    lookup->hash = calloc(lookup->size, sizeof(unsigned int));
+    for (i = 0; i < params->num_tables; i++){
+	hash = hash_key(params->tablelist[i]);
+	bucket = hash & (lookup->size - 1);
+	while (lookup->slot[bucket] != 0){
+	    bucket = (bucket + 1) & (lookup->size - 1);
+	}
+	lookup->slot[bucket] = i + 1;
+	lookup->hash[bucket] = hash;
+    }
+}
+
+int find_index(struct config_params *params, const char* name)
+{
+    const struct tableindex *lookup = &params->tableindex;
+    unsigned int hash = hash_key(name);
+    unsigned int bucket = hash & (lookup->size - 1);
+    int i;
+    while ((i = lookup->slot[bucket]) != 0){
+	if (lookup->hash[bucket] == hash && strcmp(params->tablelist[i - 1], name) == 0){
+	    return i - 1;
+	}
+	bucket = (bucket + 1) & (lookup->size - 1);
+    }
+    return -1;
+}
+
+int columncopy(struct column *source, struct column *dest)
+{
+    strncpy(dest->typename, source->typename, sizeof(dest->typename));
+    dest->flag = source->flag;
+    if(dest->flag == true){
+	strncpy(dest->strval, source->strval, sizeof(dest->strval));
+    }
+    else{
+	dest->intval = source->intval;
+    }
+    return 1;
+}  
+
+void cleanstring(char *string)
+{
+    int i = 0;
+    if(string != NULL){
+	while(string[i] != '\0'){
+	    i++;
+	}
+	for(; i >= 0; i--){
+	    string[i] = '\0';
+	}
+    }
+}
+
+int count_column(char *source)
 {
     //reads value string and populates columns in that specific struct
-    struct column *dest = target->columnlist;
     printf("source: %s\n", source);
     char tempint[1024];
     bool typeflag = false;
     bool strflag = false;
     bool intflag = false;
-    int i = 0;//source string address
-    int j = 0;//dest column list
-    int k = 0;//char copy counter
-    k=0;
-    while(source[i] != '?' && source[i] != '\0'){
-	//printf("source[i] = %c \n", source[i]);
-	if(source[i] != '@' && typeflag == true){//write to typename
-	    dest[j].typename[k] = source[i];//copy char
-	    k++;//increment char counter
+    int i = 0;//source string address
+    int j = 0;//dest column list
+    int k = 0;//char copy counter
+    k=0;
+
+    while(source[i] != '?' && source[i] != '\0'){
+	//printf("source[i] = %c \n", source[i]);
+	if(source[i] != '@' && typeflag == true){//write to typename
+	    k++;//increment char counter
+	}
+	else if(source[i] != '$' && strflag == true){//write to strval
+	    k++;//increment char counter
+	}
+	else if(source[i] != '#' && intflag == true){//write to intval
+	    tempint[k] = source[i];//copy char to tempint for conversion later
+	    k++;//increment char counter
+	}
+	//get dest ready
+	if(source[i] == '@'){//name encountered
+	    if(typeflag == true){//already enabled
+		typeflag = false;//disable (second '@' encountered)
+		k = 0;//reset char counter
+	    }
+	    else typeflag = true;
+	}
+	else if(source[i] == '$'){//string encountered
+	    if(strflag == true){
+		strflag = false;//second '$' encountered
+		k = 0;//reset char counter
+	    }
+	    else strflag = true;
+	}
+	else if(source[i] == '#'){//int encountered
+	    if(intflag == true){
+		intflag = false;//second '#' encountered
+		tempint[k] = '\0';
+		k = 0;//reset char counter
+	    }
+	    else intflag = true;
+	}
+	else if(source[i] == '!'){//column ends, go to next column
+	    j++;//increment column counter
+	}
+	i++;//increment i and repeat
+    }
+    printf("j=%d\n", j);
+    return j;
+}
+
+
+
+int decode_value(struct schema *schema, char *row, char strvals[][MAX_VALUE_LEN], char *source)
+{
+    //reads value string and packs the int and float columns into row at their schema offsets,
+    //string column j is copied to strvals[j] to be interned by the caller
+    //returns the number of columns, or -1 if a column doesn't match the schema
+    char typename[MAX_STRTYPE_SIZE];
+    char tempval[1024];
+    char *end;
+    long value;
+    struct schemacolumn *column;
+    bool typeflag = false;
+    bool strflag = false;
+    bool intflag = false;
+    bool valueflag = false;//column j has its value
+    int i = 0;//source string address
+    int j = 0;//schema column
+    int k = 0;//char copy counter
+    while(source[i] != '?' && source[i] != '\0'){
+	if(source[i] != '@' && typeflag == true){//write to typename
+	    if(k < MAX_STRTYPE_SIZE - 1){
+		typename[k] = source[i];
+	    }
+	    k++;
+	}
+	else if((source[i] != '$' && strflag == true) || (source[i] != '#' && intflag == true)){
+	    if(k < (int)sizeof(tempval) - 1){
+		tempval[k] = source[i];
+	    }
+	    k++;
+	}
+	if(source[i] == '@'){//name encountered
+	    if(typeflag == true){//already enabled
+		typeflag = false;//disable (second '@' encountered)
+		typename[k < MAX_STRTYPE_SIZE ? k : MAX_STRTYPE_SIZE - 1] = '\0';
+		k = 0;//reset char counter
+	    }
+	    else typeflag = true;
+	}
+	else if(source[i] == '$' || source[i] == '#'){//value encountered
+	    if(strflag == true || intflag == true){
+		//second '$' or '#' encountered, column j is complete
+		tempval[k < (int)sizeof(tempval) ? k : (int)sizeof(tempval) - 1] = '\0';
+		if(j >= schema->numcolumns || valueflag == true){
+		    return -1;
+		}
+		column = &schema->columns[j];
+		if(strcmp(column->name, typename) != 0){
+		    return -1;
+		}
+		if(strflag == true){
+		    if(column->type != COLUMN_STR || k > column->length){
+			return -1;
+		    }
+		    strcpy(strvals[j], tempval);
+		    *(unsigned int *)(row + column->offset) = 0;
+		}
+		else if(column->type == COLUMN_FLOAT){
+		    //an int literal is a float as well
+		    if(parse_float(tempval, (int *)(row + column->offset)) != 0){
+			return -1;
+		    }
+		}
+		else {
+		    value = strtol(tempval, &end, 10);
+		    if(column->type != COLUMN_INT || end == tempval || *end != '\0' || value < INT_MIN || value > INT_MAX){
+			return -1;//a float for an int column
+		    }
+		    *(int *)(row + column->offset) = value;
+		}
+		strflag = false;
+		intflag = false;
+		valueflag = true;
+		k = 0;//reset char counter
+	    }
+	    else if(source[i] == '$'){
+		strflag = true;
+	    }
+	    else intflag = true;
+	}
+	else if(source[i] == '!'){//column ends, go to next column
+	    if(valueflag == false){
+		return -1;//a column without a value
+	    }
+	    valueflag = false;
+	    j++;//increment column counter
+	}
+	i++;//increment i and repeat
+    }
+    return j;
+}
+
+void print_column(struct column *column)
+{
+    //prints a column
+    //printf("typename: %s; ", column->typename);
+    //printf("value: ");
+    if(column->flag==true){
+	printf("%s ", column->strval);
+    }
+    else{
+	printf("%d ", column->intval);
+    }
+    printf("\n");
+}
+
+int encode_value(struct citytable *table, char *row, char *target)
+{
+    struct schema *schema = &table->schema;
+    //encodes the columns of a row into one string using protocol
+    char tempstring[1024];
+    int j=0;
+    while(j<schema->numcolumns){
+	strcat(target, "@");
+	strcat(target, schema->columns[j].name);
+	strcat(target, "@");
+	if(schema->columns[j].type == COLUMN_STR){
+	    //char
+	    strcat(target, "$");
+	    strcat(target, strheap_get(&table->strings, row_handle(row, &schema->columns[j])));
+	    strcat(target, "$");
+	}
+	else {
+	    //int or float
+	    strcat(target, "#");
+	    if(schema->columns[j].type == COLUMN_FLOAT){
+		sprintf(tempstring, "%.9g", key_float(row_int(row, &schema->columns[j])));
+	    }
+	    else {
+		sprintf(tempstring, "%d", row_int(row, &schema->columns[j]));
+	    }
+	    strcat(target, tempstring);
+	    strcat(target, "#");
+	}
+	strcat(target, "!");
+	j++;//increment column counter
+    }
+    strcat(target, "?"); 
+    return 0;
+}
+
+int decode_line(char *received, char *command, char *tablename, char *keyname, char *value, int *counter)
+{
+    //decodes a line received from client into respective arguments
+    bool commandflag = false;
+    bool nameflag = false;
+    bool keyflag = false;
+    bool valueflag = false;
+    bool atflag = false;
+    bool counterflag = false;
+    bool nocounter = true;
+    int j=0;//dest counter
+    int i=0;//received line counter
+    char tempcounter[100];
+    while(received[i]!='\0'){
+	//puts("in decode_line while loop");
+	if(commandflag == true && received[i] != '&'){
+	    command[j] = received[i];
+	    j++;
+	}
+	else if(nameflag == true && received[i] != '^'){
+	    tablename[j] = received[i];
+	    j++;
+	}
+	else if(keyflag == true && received[i] != '*'){
+	    keyname[j] = received[i];
+	    j++;
+	}
+	else if(counterflag == true && received[i] != '~'){
+	    tempcounter[j] = received[i];
+			j++;
+	}
+	else if(valueflag == true){
+	    value[j] = received[i];
+	    j++;
+	}
+	if(received[i] == '&'){
+	    if(commandflag == true){
+		commandflag = false;
+		command[j] = '\0';
+		j=0;
+	    }
+	    else commandflag = true;
+	}
+	else if(received[i] == '^'){
+	    if(nameflag == true){
+		nameflag = false;
+		tablename[j] = '\0';
+		j=0;
+	    }
+	    else nameflag = true;
+	}
+	else if(received[i] == '*'){
+			if(keyflag == true){
+			    keyflag = false;
+			keyname[j] = '\0';
+			j=0;
+			}
+			else keyflag = true;
+	}
+	else if(received[i] == '@'){
+	    valueflag = true;
+	    if(atflag == false){
+		atflag = true;
+		value[j] = '@';
+		j++;
+	    }
+	    //value[j] = received[i];
+	    //j++;
+	}
+	else if(received[i] == '~'){
+	    if(counterflag == true){
+				counterflag = false;
+				tempcounter[j] = '\0';
+				j=0;
+	    }
+	    else {
+		valueflag = false;
+		value[j-1] = '\0';
+		j = 0;	
+		counterflag = true;
+		nocounter = false;
+	    }
+	}
+	i++;
+    }
+    if(nocounter == true){
+	i = 0;
+	while(value[i] != '?'){
+	    i++;
+	}
+	value[i+1] = '\0';
+    }
+    *counter = atoi(tempcounter);
+    //value[j] = '\0';
+    return 0;
+}
+
+int encode_line(char *type, char *status, char *statustwo, char *retline)
+{
+    /*encodes a line to be sent back to the client containing
+      appropriate arguments*/
+    sprintf(retline, "%s %s %s", type, status, statustwo);
+    return 0;
+}
+
+int encode_columns(struct citytable *table, char *row, int *columns, int numcolumns, char *retval)
+{
+    struct schema *schema = &table->schema;
+    //encodes the values of the given columns as "<name> <value>,..."
+    char tempstring[1024];
+    int i, j;
+    for(i = 0; i < numcolumns; i++){
+	j = columns[i];
+	strcat(retval, schema->columns[j].name);
+	strcat(retval, " ");
+	if(schema->columns[j].type == COLUMN_STR){
+	    //char
+	    strcat(retval, strheap_get(&table->strings, row_handle(row, &schema->columns[j])));
+	}
+	else if(schema->columns[j].type == COLUMN_FLOAT){
+	    //9 digits give the float back exactly
+	    sprintf(tempstring, "%.9g", key_float(row_int(row, &schema->columns[j])));
+	    strcat(retval, tempstring);
+	}
+	else {
+	    //int
+	    sprintf(tempstring, "%d", row_int(row, &schema->columns[j]));
+	    strcat(retval, tempstring);
+	}
+	if(i < numcolumns - 1){
+	    strcat(retval, ",");
+	}
+    }
+    return 0;
+}
+
+int encode_retval(struct citytable *table, char *row, char *retval)
+{
+    //encodes values from the columns into a line for further usage
+    int columns[MAX_COLUMNS_PER_TABLE];
+    int j;
+    for(j = 0; j < table->schema.numcolumns; j++){
+	columns[j] = j;
+    }
+    encode_columns(table, row, columns, table->schema.numcolumns, retval);
+    strcat(retval, " END");
+    return 0;
+}
+
+int query_argument(struct queryarg *querylist, char *values)
+{
+    bool firstflag = false;
+    bool secondflag = false;
+    bool intflag = false;
+    bool opflag = false;
+    bool orderflag = false;
+    bool limitflag = false;
+    char tempint[1024];
+    int i = 0; //values counter
+    int j = 0; //array y index
+    int k = 0; //array x index
+    querylist->orderby[0] = '\0';
+    querylist->direction = 0;
+    querylist->limit = -1;
+    while(values[i] != '\0') {
+	if(firstflag == true && values[i] != '@') {
+	    querylist->firstarg[j][k] = values[i];
+	    k++;
+	}
+	else if(secondflag == true && values[i] != '$'){
+	    querylist->secondarg[j][k] = values[i];
+	    k++;
+	}
+	else if(opflag == true && values[i] != '&'){
+	    querylist->operator[j] = values[i];
+	}
+	else if(intflag == true && values[i] != '#'){
+	    tempint[k] = values[i];
+	    k++;
+	}
+	else if(orderflag == true && values[i] != '%'){
+	    querylist->orderby[k] = values[i];
+	    k++;
+	}
+	else if(limitflag == true && values[i] != '~'){
+	    tempint[k] = values[i];
+	    k++;
+	}
+	if(values[i] == '@'){
+	    if(firstflag == true){
+		firstflag = false;
+		querylist->firstarg[j][k] = '\0';
+		k = 0;
+	    }
+	    else firstflag = true;
+	}
+	else if(values[i] == '#'){
+	    if(intflag == true){
+		intflag = false;
+		tempint[k] = '\0';
+		k = 0;
+		querylist->max_keys = atoi(tempint);
+	    }
+	    else intflag = true;
+	}
+	else if(values[i] == '%'){
+	    //%<column>% then '<' for ascending or '>' for descending
+	    if(orderflag == true){
+		orderflag = false;
+		querylist->orderby[k] = '\0';
+		k = 0;
+		querylist->direction = values[i+1];
+		if(values[i+1] != '\0'){
+		    i++;
+		}
+	    }
+	    else orderflag = true;
+	}
+	else if(values[i] == '~'){
+	    if(limitflag == true){
+		limitflag = false;
+		tempint[k] = '\0';
+		k = 0;
+		querylist->limit = atoi(tempint);
+	    }
+	    else limitflag = true;
+	}
+	else if(values[i] == '&'){
+	    if(opflag == true){
+		opflag = false;
+	    }
+	    else opflag = true;
+	}
+	else if(values[i] == '!'){
+	    if(j == MAX_COLUMNS_PER_TABLE - 1){
+		//no room for another predicate
+		return values[i+1] == '\0' ? j+1 : -1;
+	    }
+	    j++;
+	}
+	else if(values[i] == '$'){
+	    if(secondflag == true){
+		secondflag = false;
+		querylist->secondarg[j][k] = '\0';
+		k = 0;
+	    }
+	    else secondflag = true;
+	}
+	i++;
+    }
+    return j+1;//number of query arguments
+}
+
+//Entries in the posting list of handle, for readers
+static unsigned int strindex_count(struct strindex *index, unsigned int handle)
+{
+    unsigned int numlists = LOAD_ACQUIRE(index->numlists);
+    struct postlist *lists = LOAD_ACQUIRE(index->lists);
+    return handle < numlists ? LOAD_ACQUIRE(lists[handle].count) : 0;
+}
+
+//Slots the bitmap of handle holds, for readers
+static unsigned long bitmapindex_count(struct bitmapindex *index, unsigned int handle)
+{
+    unsigned int numvalues = LOAD_ACQUIRE(index->numvalues);
+    struct valuebitmap *values = LOAD_ACQUIRE(index->values);
+    return handle < numvalues ? LOAD_ACQUIRE(values[handle].count) : 0;
+}
+
+static int int_order(const void *a, const void *b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static unsigned long long isqrt(unsigned long long x)
+{
+    //floor of the square root, by Newton's method, so there's no libm to link
+    unsigned long long r = x, next;
+    if(x < 2){
+	return x;
+    }
+    for(next = (r + x / r) / 2; next < r; next = (r + x / r) / 2){
+	r = next;
+    }
+    return r;
+}
+
+void stats_refresh(struct citytable *table)
+{
+    struct tablestats *old = table->stats;
+    struct tablestats *stats;
+    struct colstore *store = &table->columns;
+    struct schema *schema = &table->schema;
+    struct colstats *col;
+    unsigned long rows = table->order.length;
+    unsigned long step = rows / STATS_SAMPLE + 1;
+    unsigned long seen = 0;
+    unsigned long bits, distinct, once;
+    unsigned int sample[STATS_SAMPLE];
+    int values[STATS_SAMPLE];
+    unsigned int n = 0;
+    unsigned int w, slot, i, k;
+    int j, value;
+    if(old != NULL && table->version - old->version < old->rows / STATS_STALE + STATS_MIN_CHANGES){
+	return;
+    }
+    stats = calloc(1, sizeof(struct tablestats));
+    stats->rows = rows;
+    stats->version = table->version;
+    for(j = 0; j < schema->numcolumns; j++){
+	stats->columns[j].min = INT_MAX;
+	stats->columns[j].max = INT_MIN;
+    }
+    //min and max over every record, the rest from every step-th one
+    for(w = 0; w * BITMAP_WORD_BITS < store->high; w++){
+	for(bits = store->valid[w]; bits != 0; bits &= bits - 1){
+	    slot = w * BITMAP_WORD_BITS + __builtin_ctzl(bits);
+	    for(j = 0; j < schema->numcolumns; j++){
+		value = store->values[j][slot];
+		if(value < stats->columns[j].min){
+		    stats->columns[j].min = value;
+		}
+		if(value > stats->columns[j].max){
+		    stats->columns[j].max = value;
+		}
+	    }
+	    if(seen++ % step == 0 && n < STATS_SAMPLE){
+		sample[n++] = slot;
+	    }
+	}
+    }
+    for(j = 0; j < schema->numcolumns && n > 0; j++){
+	col = &stats->columns[j];
+	for(i = 0; i < n; i++){
+	    values[i] = store->values[j][sample[i]];
+	}
+	qsort(values, n, sizeof(int), int_order);
+	distinct = 0;
+	once = 0;
+	for(i = 0; i < n; i = k){
+	    for(k = i + 1; k < n && values[k] == values[i]; k++);
+	    distinct++;
+	    once += k - i == 1;
+	}
+	if(n < rows){
+	    //values seen once in the sample stand for the unseen ones (GEE)
+	    //once * (sqrt(rows / n) - 1), once * once * rows fits as once <= STATS_SAMPLE
+	    distinct += isqrt((unsigned long long)once * once * rows / n) - once;
+	}
+	col->distinct = distinct < rows ? distinct : rows;
+	for(i = 0; i <= STATS_BUCKETS; i++){
+	    col->bounds[i] = values[(unsigned long)i * (n - 1) / STATS_BUCKETS];
+	}
+	col->bounds[0] = col->min;
+	col->bounds[STATS_BUCKETS] = col->max;
+    }
+    STORE_RELEASE(table->stats, stats);
+    if(old != NULL){
+	ebr_retire(reclaim_array, NULL, old);
+    }
+    colstore_rezone(store, schema);
+}
+
+//Share of the values of col under value, interpolated within a bucket
+static double stats_below(struct colstats *col, int value)
+{
+    int i;
+    if(value <= col->min){
+	return 0;
+    }
+    if(value > col->max){
+	return 1;
+    }
+    for(i = 0; col->bounds[i + 1] < value; i++);
+    return (i + ((double)value - col->bounds[i]) / ((double)col->bounds[i + 1] - col->bounds[i])) / STATS_BUCKETS;
+}
+
+//Records expected to pass pred
+static unsigned long stats_estimate(struct tablestats *stats, struct citytable *table, struct predicate *pred)
+{
+    struct colstats *col = &stats->columns[pred->column];
+    double share;
+    if(table->schema.columns[pred->column].type == COLUMN_STR){
+	if(table->schema.columns[pred->column].index == INDEX_HASH){
+	    return strindex_count(&table->hashed[pred->column], pred->value);
 	}
-	else if(source[i] != '$' && strflag == true){//write to strval
-	    dest[j].flag = true;//set flag to string mode
-	    dest[j].strval[k] = source[i];
-	    k++;//increment char counter
+	if(table->schema.columns[pred->column].index == INDEX_BITMAP){
+	    return bitmapindex_count(&table->bitmaps[pred->column], pred->value);
 	}
-	else if(source[i] != '#' && intflag == true){//write to intval
-	    dest[j].flag = false;//set flag to int mode
-	    tempint[k] = source[i];//copy char to tempint for conversion later
-	    k++;//increment char counter
+	return pred->value == 0 || col->distinct == 0 ? 0 : (stats->rows + col->distinct - 1) / col->distinct;
+    }
+    if(stats->rows == 0 || (pred->operator == '=' && (pred->value < col->min || pred->value > col->max))){
+	return 0;
+    }
+    if(pred->operator == '='){
+	return (stats->rows + col->distinct - 1) / col->distinct;
+    }
+    if(pred->operator == '<'){
+	share = stats_below(col, pred->value);
+    }
+    else {
+	share = pred->value == INT_MAX ? 0 : 1 - stats_below(col, pred->value + 1);
+    }
+    return (unsigned long)(share * stats->rows + 0.5);
+}
+
+static int estimate_order(const void *a, const void *b)
+{
+    const struct predicate *x = a;
+    const struct predicate *y = b;
+    return (x->estimate > y->estimate) - (x->estimate < y->estimate);
+}
+
+//Orders the predicates by estimated matches and picks the index, if
+//any, that is worth walking instead of the colstore
+static void query_plan(struct queryprog *prog, struct tablestats *stats, struct citytable *table)
+{
+    struct predicate *pred;
+    double share = 1;
+    int j, type, index;
+    for(j = 0; j < prog->count; j++){
+	prog->preds[j].estimate = stats_estimate(stats, table, &prog->preds[j]);
+	//an exact index count can be ahead of the statistics
+	share *= prog->preds[j].estimate < stats->rows ? (double)prog->preds[j].estimate / stats->rows : 1;
+    }
+    //predicates are taken as independent
+    prog->estimate = (unsigned long)(share * stats->rows + 0.5);
+    qsort(prog->preds, prog->count, sizeof(struct predicate), estimate_order);
+    prog->lead = -1;
+    for(j = 0; j < prog->count; j++){
+	pred = &prog->preds[j];
+	type = table->schema.columns[pred->column].type;
+	index = table->schema.columns[pred->column].index;
+	if(((type == COLUMN_STR && index == INDEX_HASH) || (type != COLUMN_STR && index == INDEX_SORTED))
+	   && pred->estimate < stats->rows / PLAN_INDEX_SHARE + 1){
+	    prog->lead = j;//the first indexed one is the most selective
+	    break;
 	}
-	//get dest ready
-	if(source[i] == '@'){//name encountered
-	    if(typeflag == true){//already enabled
-		typeflag = false;//disable (second '@' encountered)
-		dest[j].typename[k] = '\0';
-		k = 0;//reset char counter
+    }
+}
+
+int query_compile(struct queryprog *prog, struct queryarg *querylist, int querynum, struct citytable *table)
+{
+    struct schema *schema = &table->schema;
+    struct predicate *pred;
+    unsigned long cost, leadcost = ULONG_MAX;
+    char *end;
+    long value;
+    int j;
+    struct tablestats *stats = LOAD_ACQUIRE(table->stats);
+    prog->count = 0;
+    prog->lead = -1;
+    prog->nomatch = false;
+    prog->estimate = ULONG_MAX;
+    prog->order = -1;
+    prog->descending = querylist->direction == '>';
+    prog->limit = querylist->limit;
+    if(querynum < 0){
+	return -1;
+    }
+    if(querylist->orderby[0] != '\0'){
+	//string handles have no order
+	prog->order = schema_column(schema, querylist->orderby);
+	if(prog->order < 0 || schema->columns[prog->order].type == COLUMN_STR
+	   || (querylist->direction != '<' && querylist->direction != '>')){
+	    return -1;
+	}
+    }
+    for(j = 0; j < querynum; j++){
+	if(querylist->firstarg[j][0] == '\0'){
+	    continue;//nothing after the last '!'
+	}
+	pred = &prog->preds[prog->count];
+	pred->column = schema_column(schema, querylist->firstarg[j]);
+	pred->operator = querylist->operator[j];
+	pred->estimate = ULONG_MAX;
+	if(pred->column < 0){
+	    return -1;
+	}
+	if(schema->columns[pred->column].type == COLUMN_STR){
+	    if(pred->operator != '='){
+		return -1;//'=' only for strings
 	    }
-	    else typeflag = true;
+	    //equal strings share one handle, 0 when no record holds it
+	    pred->value = strheap_find(&table->strings, querylist->secondarg[j]);
+	    if(pred->value == 0){
+		prog->nomatch = true;
+	    }
+	    //the shortest posting list leads, it bounds the matches
+	    cost = schema->columns[pred->column].index == INDEX_HASH
+		? strindex_count(&table->hashed[pred->column], pred->value) : ULONG_MAX;
 	}
-	else if(source[i] == '$'){//string encountered
-	    if(strflag == true){
-		strflag = false;//second '$' encountered
-		dest[j].strval[k] = '\0';
-		k = 0;//reset char counter
+	else {
+	    if(pred->operator != '<' && pred->operator != '>' && pred->operator != '='){
+		return -1;
 	    }
-	    else strflag = true;
+	    if(schema->columns[pred->column].type == COLUMN_FLOAT){
+		//compared as float keys, which order like the floats
+		if(parse_float(querylist->secondarg[j], &pred->value) != 0){
+		    return -1;
+		}
+	    }
+	    else {
+		value = strtol(querylist->secondarg[j], &end, 10);
+		if(end == querylist->secondarg[j] || *end != '\0' || value < INT_MIN || value > INT_MAX){
+		    return -1;
+		}
+		pred->value = value;
+	    }
+	    //sorted ranges only beat a scan, an equality beats a range
+	    cost = schema->columns[pred->column].index != INDEX_SORTED ? ULONG_MAX
+		: pred->operator == '=' ? ULONG_MAX - 2 : ULONG_MAX - 1;
 	}
-	else if(source[i] == '#'){//int encountered
-	    if(intflag == true){
-		intflag = false;//second '#' encountered
-		tempint[k] = '\0';
-		dest[j].intval = atoi(tempint);//convert string to int
-		k = 0;//reset char counter
+	if(cost < leadcost){
+	    prog->lead = prog->count;
+	    leadcost = cost;
+	}
+	prog->count++;
+    }
+    if(stats != NULL && stats->rows > 0){
+	query_plan(prog, stats, table);
+    }
+    return 0;
+}
+
+static inline bool predicate_test(char operator, int value, int constant)
+{
+    switch(operator){
+    case '<': return value < constant;
+    case '>': return value > constant;
+    default: return value == constant;
+    }
+}
+
+//Whether slot passes every predicate; the colstore decides, an index
+//entry may be mid-move by a modify
+static inline bool query_test(struct queryprog *prog, const int **values, unsigned int slot)
+{
+    int j;
+    for(j = 0; j < prog->count; j++){
+	if(!predicate_test(prog->preds[j].operator, values[j][slot], prog->preds[j].value)){
+	    return false;
+	}
+    }
+    return true;
+}
+
+//Sets the bit of slot in match if it passes every predicate
+static inline void query_candidate(struct queryprog *prog, const int **values, unsigned int slot, unsigned int slots, unsigned long *match)
+{
+    if(slot >= slots){
+	return;//added after the caller read the colstore
+    }
+    if(query_test(prog, values, slot)){
+	match[slot / BITMAP_WORD_BITS] |= 1UL << (slot % BITMAP_WORD_BITS);
+    }
+}
+
+//ANDs the bitmap of handle into match, words [first, last)
+static void bitmapindex_and(struct bitmapindex *index, unsigned int handle,
+			    unsigned int first, unsigned int last, unsigned long *match)
+{
+    unsigned int numvalues = LOAD_ACQUIRE(index->numvalues);
+    struct valuebitmap *values = LOAD_ACQUIRE(index->values);
+    struct container *blocks = NULL;
+    struct slotarray *array;
+    unsigned long *bits;
+    unsigned long mask;
+    unsigned int numblocks = 0;
+    unsigned int b, w, to, k;
+    if(handle < numvalues){
+	numblocks = LOAD_ACQUIRE(values[handle].numblocks);
+	blocks = LOAD_ACQUIRE(values[handle].blocks);
+    }
+    for(w = first; w < last; w = to){
+	b = w / CONTAINER_WORDS;
+	to = (b + 1) * CONTAINER_WORDS < last ? (b + 1) * CONTAINER_WORDS : last;
+	array = NULL;
+	bits = NULL;
+	if(blocks != NULL && b < numblocks){
+	    //array first, it is only cleared once bits is set
+	    array = LOAD_ACQUIRE(blocks[b].array);
+	    bits = LOAD_ACQUIRE(blocks[b].bits);
+	}
+	if(bits != NULL){
+	    for(; w < to; w++){
+		match[w - first] &= __atomic_load_n(&bits[w % CONTAINER_WORDS], __ATOMIC_ACQUIRE);
 	    }
-	    else intflag = true;
 	}
-	else if(source[i] == '!'){//column ends, go to next column
-	    j++;//increment column counter
+	else if(array != NULL){
+	    for(k = 0; k < array->count && array->low[k] / BITMAP_WORD_BITS < w % CONTAINER_WORDS; k++);
+	    for(; w < to; w++){
+		mask = 0;
+		for(; k < array->count && array->low[k] / BITMAP_WORD_BITS == w % CONTAINER_WORDS; k++){
+		    mask |= 1UL << (array->low[k] % BITMAP_WORD_BITS);
+		}
+		match[w - first] &= mask;
+	    }
+	}
+	else {
+	    for(; w < to; w++){
+		match[w - first] = 0;
+	    }
 	}
-	i++;//increment i and repeat
     }
-    printf("j=%d\n", j);
-    return j;
 }
 
-void print_column(struct column *column)
+//Clears the bits of match, words [first, last), of the slots failing
+//prog; bitmap indexes and zone bounds clear words before the colstore
+//is read, which still has the last word
+static void query_filter(struct citytable *table, struct queryprog *prog, unsigned int slots,
+			 unsigned int first, unsigned int last, unsigned long *match)
 {
-    //prints a column
-    //printf("typename: %s; ", column->typename);
-    //printf("value: ");
-    if(column->flag==true){
-	printf("%s ", column->strval);
+    struct colstore *store = &table->columns;
+    const int *zonemin, *zonemax;
+    unsigned int z, w, from, to;
+    int j, low, high;
+    for(j = 0; j < prog->count; j++){
+	if(table->schema.columns[prog->preds[j].column].index == INDEX_BITMAP){
+	    bitmapindex_and(&table->bitmaps[prog->preds[j].column], prog->preds[j].value, first, last, match);
+	}
     }
-    else{
-	printf("%d ", column->intval);
+    for(j = 0; j < prog->count; j++){
+	zonemin = LOAD_ACQUIRE(store->zonemin[prog->preds[j].column]);
+	zonemax = LOAD_ACQUIRE(store->zonemax[prog->preds[j].column]);
+	for(z = first * BITMAP_WORD_BITS / ZONE_SLOTS; z * ZONE_SLOTS < last * BITMAP_WORD_BITS; z++){
+	    low = __atomic_load_n(&zonemin[z], __ATOMIC_ACQUIRE);
+	    high = __atomic_load_n(&zonemax[z], __ATOMIC_ACQUIRE);
+	    if(prog->preds[j].operator == '<' ? low < prog->preds[j].value
+	       : prog->preds[j].operator == '>' ? high > prog->preds[j].value
+	       : low <= prog->preds[j].value && prog->preds[j].value <= high){
+		continue;
+	    }
+	    from = z * ZONE_SLOTS / BITMAP_WORD_BITS > first ? z * ZONE_SLOTS / BITMAP_WORD_BITS : first;
+	    to = (z + 1) * ZONE_SLOTS / BITMAP_WORD_BITS < last ? (z + 1) * ZONE_SLOTS / BITMAP_WORD_BITS : last;
+	    for(w = from; w < to; w++){
+		match[w - first] = 0;
+	    }
+	}
+    }
+    for(j = 0; j < prog->count; j++){
+	colstore_filter(store, slots, first, last, prog->preds[j].column, prog->preds[j].operator, prog->preds[j].value, match);
     }
-    printf("\n");
 }
 
-int encode_value(struct column column[10], char *target, int limit)
+//Sets the bits of match for the slots the lead predicate's index holds
+//that pass every predicate, slots being the capacity the caller read
+static void query_index(struct queryprog *prog, struct citytable *table, unsigned int slots, unsigned long *match)
 {
-    //encodes <limit> number of columns into one string using protocol
-    char tempstring[1024];
-    int j=0;
-    while(j<limit){
-	strcat(target, "@");
-	strcat(target, column[j].typename);
-	strcat(target, "@");
-	if(column[j].flag == true){
-	    //char
-	    strcat(target, "$");
-	    strcat(target, column[j].strval);
-	    strcat(target, "$");
+    struct predicate *lead = &prog->preds[prog->lead];
+    struct colstore *store = &table->columns;
+    const int *values[MAX_COLUMNS_PER_TABLE];
+    struct intnode *x;
+    unsigned int count, i;
+    unsigned int *postings;
+    int j;
+    for(j = 0; j < prog->count; j++){
+	values[j] = LOAD_ACQUIRE(store->values[prog->preds[j].column]);
+    }
+    if(table->schema.columns[lead->column].index == INDEX_HASH){
+	struct strindex *index = &table->hashed[lead->column];
+	unsigned int numlists = LOAD_ACQUIRE(index->numlists);
+	struct postlist *lists = LOAD_ACQUIRE(index->lists);
+	if((unsigned int)lead->value >= numlists){
+	    return;
+	}
+	count = LOAD_ACQUIRE(lists[lead->value].count);
+	postings = LOAD_ACQUIRE(lists[lead->value].slots);
+	for(i = 0; postings != NULL && i < count; i++){
+	    query_candidate(prog, values, __atomic_load_n(&postings[i], __ATOMIC_ACQUIRE), slots, match);
+	}
+	return;
+    }
+    if(lead->operator == '<'){
+	x = LOAD_ACQUIRE(table->sorted[lead->column].header->forward[0]);
+    }
+    else if(lead->operator == '>'){
+	if(lead->value == INT_MAX){
+	    return;
+	}
+	x = intindex_seek(&table->sorted[lead->column], lead->value + 1);
+    }
+    else {
+	x = intindex_seek(&table->sorted[lead->column], lead->value);
+    }
+    for(; x != NULL; x = LOAD_ACQUIRE(x->forward[0])){
+	if((lead->operator == '<' && x->value >= lead->value) || (lead->operator == '=' && x->value != lead->value)){
+	    break;
+	}
+	query_candidate(prog, values, x->slot, slots, match);
+    }
+}
+
+//Adds the keys of the slots set in match, words [first, last), to keys
+static void query_emit(struct keylist *keys, struct city **rows, unsigned int first, unsigned int last, unsigned long *match, int limit)
+{
+    struct city *row;
+    unsigned long bits;
+    unsigned int w, b;
+    for(w = first; w < last && keys->count < limit; w++){
+	bits = match[w - first];
+	for(b = 0; bits != 0 && keys->count < limit; b++, bits >>= 1){
+	    //a row deleted since the bitmap was copied has left its slot
+	    if((bits & 1) && (row = LOAD_ACQUIRE(rows[w * BITMAP_WORD_BITS + b])) != NULL){
+		keylist_add(keys, row->name);
+	    }
+	}
+    }
+}
+
+//Scans the colstore words [first, last) one morsel at a time
+static void query_scan(struct keylist *keys, struct queryprog *prog, struct citytable *table, unsigned int slots,
+		       unsigned int first, unsigned int last, int limit)
+{
+    struct colstore *store = &table->columns;
+    struct city **rows = LOAD_ACQUIRE(store->rows);
+    unsigned long *valid = LOAD_ACQUIRE(store->valid);
+    unsigned long match[MORSEL_WORDS];
+    unsigned int from, to, w;
+    for(from = first; from < last && keys->count < limit; from = to){
+	to = from + MORSEL_WORDS < last ? from + MORSEL_WORDS : last;
+	for(w = from; w < to; w++){
+	    match[w - from] = __atomic_load_n(&valid[w], __ATOMIC_ACQUIRE);
+	}
+	query_filter(table, prog, slots, from, to, match);
+	query_emit(keys, rows, from, to, match, limit);
+    }
+}
+
+/* Mutex guarding the QUERY job queue and the jobs in it */
+static pthread_mutex_t queryMutex = PTHREAD_MUTEX_INITIALIZER;
+/* Condition variables -- workers wait for jobs, callers for workers to leave theirs */
+static pthread_cond_t queryWake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queryDone = PTHREAD_COND_INITIALIZER;
+static struct queryjob *queryjobs;
+static unsigned long parallel_rows;//0 while there is no pool
+
+//Claims morsels of job until none are left, then merges the keys found
+static void query_work(struct queryjob *job)
+{
+    unsigned int numwords = job->slots / BITMAP_WORD_BITS;
+    unsigned int morsel, first, last;
+    struct keylist mine;
+    int before, i;
+    keylist_init(&mine);
+    while(__atomic_load_n(&job->found, __ATOMIC_RELAXED) < job->limit
+	  && (morsel = __atomic_fetch_add(&job->nextmorsel, 1, __ATOMIC_RELAXED)) < job->nummorsels){
+	first = morsel * MORSEL_WORDS;
+	last = first + MORSEL_WORDS < numwords ? first + MORSEL_WORDS : numwords;
+	before = mine.count;
+	query_scan(&mine, job->prog, job->table, job->slots, first, last, job->limit);
+	__atomic_add_fetch(&job->found, mine.count - before, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_lock(&queryMutex);
+    for(i = 0; i < mine.count && job->keys->count < job->limit; i++){
+	keylist_add(job->keys, mine.keys[i]);
+    }
+    pthread_mutex_unlock(&queryMutex);
+    keylist_free(&mine);
+}
+
+static void* query_worker(void *arg)
+{
+    struct queryjob *job;
+    (void)arg;
+    pthread_mutex_lock(&queryMutex);
+    for(;;){
+	while(queryjobs == NULL){
+	    pthread_cond_wait(&queryWake, &queryMutex);
+	}
+	job = queryjobs;
+	if(__atomic_load_n(&job->nextmorsel, __ATOMIC_RELAXED) >= job->nummorsels){
+	    queryjobs = job->next;//all claimed, only its owner waits on it now
+	    continue;
+	}
+	job->workers++;
+	pthread_mutex_unlock(&queryMutex);
+	query_work(job);
+	pthread_mutex_lock(&queryMutex);
+	if(--job->workers == 0){
+	    pthread_cond_broadcast(&queryDone);
+	}
+    }
+    return NULL;
+}
+
+void query_pool_start(int threads, unsigned long rows)
+{
+    pthread_t thread;
+    int i;
+    if(threads == 0){
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    //the connection thread works on its own scans too
+    for(i = 1; i < threads; i++){
+	if(pthread_create(&thread, NULL, query_worker, NULL) != 0){
+	    break;
+	}
+	pthread_detach(thread);
+    }
+    parallel_rows = i > 1 ? rows : 0;
+}
+
+//Runs a colstore scan on the pool, the caller taking morsels as well
+static void query_parallel(struct keylist *keys, struct queryprog *prog, struct citytable *table, unsigned int slots, int limit)
+{
+    struct queryjob job;
+    struct queryjob **link;
+    memset(&job, 0, sizeof(job));
+    job.prog = prog;
+    job.table = table;
+    job.slots = slots;
+    job.nummorsels = (slots / BITMAP_WORD_BITS + MORSEL_WORDS - 1) / MORSEL_WORDS;
+    job.limit = limit;
+    job.keys = keys;
+    pthread_mutex_lock(&queryMutex);
+    for(link = &queryjobs; *link != NULL; link = &(*link)->next);
+    *link = &job;
+    pthread_cond_broadcast(&queryWake);
+    pthread_mutex_unlock(&queryMutex);
+    query_work(&job);
+    //the job lives on this stack, so no worker may join or stay in it
+    pthread_mutex_lock(&queryMutex);
+    for(link = &queryjobs; *link != NULL && *link != &job; link = &(*link)->next);
+    if(*link != NULL){
+	*link = job.next;
+    }
+    while(job.workers > 0){
+	pthread_cond_wait(&queryDone, &queryMutex);
+    }
+    pthread_mutex_unlock(&queryMutex);
+}
+
+void query_explain(struct queryprog *prog, struct citytable *table, unsigned long actual, char *plan, int len)
+{
+    //"<access>; <predicate> est <records>, ...; estimated <records> actual <records> of <records>",
+    //the access an index, "scan", "top" and the ORDER BY column, or "none";
+    //predicates a bitmap index answers are marked "bitmap"
+    struct schema *schema = &table->schema;
+    struct predicate *pred;
+    char value[MAX_VALUE_LEN];
+    char estimate[32];
+    int used, j;
+    if(prog->nomatch){
+	used = snprintf(plan, len, "none");
+    }
+    else if(prog->order >= 0){
+	//query_top() walks the index of the ORDER BY column or keeps a heap
+	used = snprintf(plan, len, "%s %s %s", !prog->descending && schema->columns[prog->order].index == INDEX_SORTED
+			? "index" : "top", schema->columns[prog->order].name, prog->descending ? "desc" : "asc");
+    }
+    else if(prog->lead >= 0){
+	used = snprintf(plan, len, "index %s", schema->columns[prog->preds[prog->lead].column].name);
+    }
+    else {
+	used = snprintf(plan, len, "scan");
+    }
+    for(j = 0; j < prog->count && used < len; j++){
+	pred = &prog->preds[j];
+	if(schema->columns[pred->column].type == COLUMN_STR){
+	    snprintf(value, sizeof(value), "%s", pred->value != 0 ? strheap_get(&table->strings, pred->value) : "?");
+	}
+	else if(schema->columns[pred->column].type == COLUMN_FLOAT){
+	    snprintf(value, sizeof(value), "%.9g", key_float(pred->value));
 	}
 	else {
-	    //int
-	    strcat(target, "#");
-	    sprintf(tempstring, "%d", column[j].intval);
-	    strcat(target, tempstring);
-	    strcat(target, "#");
+	    snprintf(value, sizeof(value), "%d", pred->value);
 	}
-	if(j<limit){
-	    strcat(target, "!");
+	if(pred->estimate == ULONG_MAX){
+	    strcpy(estimate, "?");
 	}
-	j++;//increment column counter
+	else {
+	    sprintf(estimate, "%lu", pred->estimate);
+	}
+	used += snprintf(plan + used, len - used, "%s %s %c %s est %s%s", j > 0 ? "," : ";",
+			 schema->columns[pred->column].name, pred->operator, value, estimate,
+			 schema->columns[pred->column].index == INDEX_BITMAP ? " bitmap" : "");
+    }
+    if(used < len){
+	if(prog->estimate == ULONG_MAX){
+	    strcpy(estimate, "?");
+	}
+	else {
+	    sprintf(estimate, "%lu", prog->estimate);
+	}
+	snprintf(plan + used, len - used, "; estimated %s actual %lu of %lu", estimate, actual, table->order.length);
+    }
+}
+
+int query_write(struct keylist *keys, struct queryprog *prog, struct citytable *table, int limit)
+{
+    //predicates are evaluated into a slot bitmap, walking an index range
+    //when one covers a predicate and scanning the colstore otherwise
+    struct colstore *store = &table->columns;
+    unsigned int slots = LOAD_ACQUIRE(store->capacity);
+    unsigned int numwords = slots / BITMAP_WORD_BITS;
+    unsigned long *match;
+    if(numwords == 0 || prog->nomatch){
+	return 0;//nothing was ever inserted or a string no record holds
+    }
+    if(prog->lead >= 0){
+	match = calloc(numwords, sizeof(unsigned long));
+	query_index(prog, table, slots, match);
+	query_emit(keys, LOAD_ACQUIRE(store->rows), 0, numwords, match, limit);
+	free(match);
+    }
+    else if(parallel_rows > 0 && table->order.length > parallel_rows && numwords > MORSEL_WORDS){
+	query_parallel(keys, prog, table, slots, limit);
+    }
+    else {
+	query_scan(keys, prog, table, slots, 0, numwords, limit);
+    }
+    return 0;
+}
+
+int aggregate_argument(char *values, char *function, char *column, char **query)
+{
+    //*<function>**<column>*<query>
+    char *end;
+    if(values[0] != '*' || (end = strchr(values + 1, '*')) == NULL){
+	return -1;
+    }
+    memcpy(function, values + 1, end - values - 1);
+    function[end - values - 1] = '\0';
+    values = end + 1;
+    if(values[0] != '*' || (end = strchr(values + 1, '*')) == NULL){
+	return -1;
+    }
+    memcpy(column, values + 1, end - values - 1);
+    column[end - values - 1] = '\0';
+    *query = end + 1;
+    return 0;
+}
+
+int projection_argument(char *values, struct schema *schema, int *columns, char **query)
+{
+    //*<column>,<column>,...*<query>, no column names for all of them
+    char names[MAXLEN];
+    char *end, *name, *save;
+    int numcolumns = 0;
+    int j;
+    if(values[0] != '*' || (end = strchr(values + 1, '*')) == NULL || end - values - 1 >= MAXLEN){
+	return -1;
+    }
+    memcpy(names, values + 1, end - values - 1);
+    names[end - values - 1] = '\0';
+    *query = end + 1;
+    if(names[0] == '\0'){
+	for(j = 0; j < schema->numcolumns; j++){
+	    columns[j] = j;
+	}
+	return schema->numcolumns;
+    }
+    for(name = strtok_r(names, ",", &save); name != NULL; name = strtok_r(NULL, ",", &save)){
+	if(numcolumns == MAX_COLUMNS_PER_TABLE || (j = schema_column(schema, name)) < 0){
+	    return -1;
+	}
+	columns[numcolumns++] = j;
+    }
+    return numcolumns;
+}
+
+//Folds the values of column in the slots set in match, words [first, last)
+static void query_fold(struct aggregate *result, struct city **rows, const int *values, bool real,
+		       unsigned int first, unsigned int last, unsigned long *match)
+{
+    unsigned long bits;
+    unsigned int w, slot;
+    int value;
+    for(w = first; w < last; w++){
+	for(bits = match[w - first]; bits != 0; bits &= bits - 1){
+	    slot = w * BITMAP_WORD_BITS + __builtin_ctzl(bits);
+	    if(LOAD_ACQUIRE(rows[slot]) == NULL){
+		continue;//deleted since the bitmap was copied
+	    }
+	    result->count++;
+	    if(values == NULL){
+		continue;
+	    }
+	    value = values[slot];
+	    if(result->count == 1 || value < result->min){
+		result->min = value;//float keys order like their floats
+	    }
+	    if(result->count == 1 || value > result->max){
+		result->max = value;
+	    }
+	    if(real){
+		result->sum += key_float(value);
+	    }
+	    else {
+		result->total += value;
+	    }
+	}
+    }
+}
+
+void query_aggregate(struct aggregate *result, struct queryprog *prog, struct citytable *table, int column)
+{
+    struct colstore *store = &table->columns;
+    unsigned int slots = LOAD_ACQUIRE(store->capacity);
+    unsigned int numwords = slots / BITMAP_WORD_BITS;
+    struct city **rows = LOAD_ACQUIRE(store->rows);
+    unsigned long *valid = LOAD_ACQUIRE(store->valid);
+    const int *values = column >= 0 ? LOAD_ACQUIRE(store->values[column]) : NULL;
+    bool real = column >= 0 && table->schema.columns[column].type == COLUMN_FLOAT;
+    unsigned long morsel[MORSEL_WORDS];
+    unsigned long *match;
+    unsigned int from, to, w;
+    memset(result, 0, sizeof(*result));
+    if(numwords == 0 || prog->nomatch){
+	return;
+    }
+    if(prog->lead >= 0){
+	match = calloc(numwords, sizeof(unsigned long));
+	query_index(prog, table, slots, match);
+	query_fold(result, rows, values, real, 0, numwords, match);
+	free(match);
+	return;
+    }
+    for(from = 0; from < numwords; from = to){
+	to = from + MORSEL_WORDS < numwords ? from + MORSEL_WORDS : numwords;
+	for(w = from; w < to; w++){
+	    morsel[w - from] = __atomic_load_n(&valid[w], __ATOMIC_ACQUIRE);
+	}
+	query_filter(table, prog, slots, from, to, morsel);
+	query_fold(result, rows, values, real, from, to, morsel);
+    }
+}
+
+unsigned long query_count(struct queryprog *prog, struct citytable *table)
+{
+    //no key, record or column value beyond the predicates' is read
+    struct colstore *store = &table->columns;
+    unsigned int slots = LOAD_ACQUIRE(store->capacity);
+    unsigned int numwords = slots / BITMAP_WORD_BITS;
+    unsigned long *valid = LOAD_ACQUIRE(store->valid);
+    unsigned long morsel[MORSEL_WORDS];
+    unsigned long *match;
+    unsigned long count = 0;
+    unsigned int from, to, w;
+    int index;
+    if(numwords == 0 || prog->nomatch){
+	return 0;
+    }
+    index = prog->count == 1 ? table->schema.columns[prog->preds[0].column].index : INDEX_NONE;
+    if(prog->count == 0){
+	count = table->order.length;
+    }
+    else if(index == INDEX_HASH){
+	//a lone string '=', the posting list or bitmap holds the count
+	count = strindex_count(&table->hashed[prog->preds[0].column], prog->preds[0].value);
+    }
+    else if(index == INDEX_BITMAP){
+	count = bitmapindex_count(&table->bitmaps[prog->preds[0].column], prog->preds[0].value);
+    }
+    else if(prog->lead >= 0){
+	match = calloc(numwords, sizeof(unsigned long));
+	query_index(prog, table, slots, match);
+	for(w = 0; w < numwords; w++){
+	    count += __builtin_popcountl(match[w] & __atomic_load_n(&valid[w], __ATOMIC_ACQUIRE));
+	}
+	free(match);
+    }
+    else {
+	for(from = 0; from < numwords; from = to){
+	    to = from + MORSEL_WORDS < numwords ? from + MORSEL_WORDS : numwords;
+	    for(w = from; w < to; w++){
+		morsel[w - from] = __atomic_load_n(&valid[w], __ATOMIC_ACQUIRE);
+	    }
+	    query_filter(table, prog, slots, from, to, morsel);
+	    for(w = from; w < to; w++){
+		count += __builtin_popcountl(morsel[w - from]);
+	    }
+	}
+    }
+    return prog->limit >= 0 && count > (unsigned long)prog->limit ? (unsigned long)prog->limit : count;
+}
+
+int cursor_fetch(struct keylist *keys, struct city **found, struct queryprog *prog, struct citytable *table, unsigned int *next, int limit)
+{
+    //a colstore scan resumed at a slot, indexes give no order to resume in
+    struct colstore *store = &table->columns;
+    unsigned int slots = LOAD_ACQUIRE(store->capacity);
+    unsigned int numwords = slots / BITMAP_WORD_BITS;
+    struct city **rows = LOAD_ACQUIRE(store->rows);
+    unsigned long *valid = LOAD_ACQUIRE(store->valid);
+    unsigned long match[MORSEL_WORDS];
+    unsigned long bits;
+    unsigned int from, to, w, slot;
+    struct city *row;
+    if(prog->nomatch){
+	*next = slots;
+    }
+    while(*next < slots && keys->count < limit){
+	from = *next / BITMAP_WORD_BITS;
+	to = from + MORSEL_WORDS < numwords ? from + MORSEL_WORDS : numwords;
+	for(w = from; w < to; w++){
+	    match[w - from] = __atomic_load_n(&valid[w], __ATOMIC_ACQUIRE);
+	}
+	match[0] &= ~0UL << (*next % BITMAP_WORD_BITS);//returned by an earlier page
+	query_filter(table, prog, slots, from, to, match);
+	*next = to * BITMAP_WORD_BITS;
+	for(w = from; w < to; w++){
+	    for(bits = match[w - from]; bits != 0; bits &= bits - 1){
+		slot = w * BITMAP_WORD_BITS + __builtin_ctzl(bits);
+		if((row = LOAD_ACQUIRE(rows[slot])) == NULL){
+		    continue;//deleted since the bitmap was copied
+		}
+		if(found != NULL){
+		    found[keys->count] = row;
+		}
+		keylist_add(keys, row->name);
+		if(keys->count == limit){
+		    *next = slot + 1;
+		    return *next >= slots;
+		}
+	    }
+	}
+    }
+    return *next >= slots;
+}
+
+struct topentry{
+    int value;//of the ORDER BY column
+    unsigned int slot;
+    struct city *row;
+};
+
+//Whether a sorts before b, ties in slot order either way
+static inline bool top_before(struct queryprog *prog, const struct topentry *a, const struct topentry *b)
+{
+    if(a->value != b->value){
+	return prog->descending ? a->value > b->value : a->value < b->value;
     }
-    strcat(target, "?"); 
-    return 0;
+    return a->slot < b->slot;
 }
 
-int decode_line(char *received, char *command, char *tablename, char *keyname, char *value, int *counter)
+//Sifts entry i of the heap down, the entry sorting last is on top
+static void top_down(struct queryprog *prog, struct topentry *heap, int count, int i)
 {
-    //decodes a line received from client into respective arguments
-    bool commandflag = false;
-    bool nameflag = false;
-    bool keyflag = false;
-    bool valueflag = false;
-    bool atflag = false;
-    bool counterflag = false;
-    bool nocounter = true;
-    int j=0;//dest counter
-    int i=0;//received line counter
-    char tempcounter[100];
-    while(received[i]!='\0'){
-	//puts("in decode_line while loop");
-	if(commandflag == true && received[i] != '&'){
-	    command[j] = received[i];
-	    j++;
-	}
-	else if(nameflag == true && received[i] != '^'){
-	    tablename[j] = received[i];
-	    j++;
-	}
-	else if(keyflag == true && received[i] != '*'){
-	    keyname[j] = received[i];
-	    j++;
+    struct topentry tmp;
+    int child;
+    for(; (child = 2 * i + 1) < count; i = child){
+	if(child + 1 < count && top_before(prog, &heap[child], &heap[child + 1])){
+	    child++;
 	}
-	else if(counterflag == true && received[i] != '~'){
-	    tempcounter[j] = received[i];
-			j++;
+	if(!top_before(prog, &heap[i], &heap[child])){
+	    break;
 	}
-	else if(valueflag == true){
-	    value[j] = received[i];
-	    j++;
+	tmp = heap[i];
+	heap[i] = heap[child];
+	heap[child] = tmp;
+    }
+}
+
+static void top_up(struct queryprog *prog, struct topentry *heap, int i)
+{
+    struct topentry tmp;
+    for(; i > 0 && top_before(prog, &heap[(i - 1) / 2], &heap[i]); i = (i - 1) / 2){
+	tmp = heap[i];
+	heap[i] = heap[(i - 1) / 2];
+	heap[(i - 1) / 2] = tmp;
+    }
+}
+
+int query_top(struct keylist *keys, struct city **found, struct queryprog *prog, struct citytable *table,
+	      bool resume, int *value, unsigned int *slot, int limit)
+{
+    struct colstore *store = &table->columns;
+    struct schemacolumn *column = &table->schema.columns[prog->order];
+    unsigned int slots = LOAD_ACQUIRE(store->capacity);
+    unsigned int numwords = slots / BITMAP_WORD_BITS;
+    struct city **rows = LOAD_ACQUIRE(store->rows);
+    unsigned long *valid = LOAD_ACQUIRE(store->valid);
+    const int *values[MAX_COLUMNS_PER_TABLE];
+    unsigned long match[MORSEL_WORDS];
+    unsigned long bits;
+    struct topentry last, entry, tmp;
+    struct topentry *heap;
+    struct intnode *x;
+    unsigned int from, to, w;
+    int count = 0;
+    bool more = false;//a match was left out
+    int i, j;
+    if((unsigned long)limit > table->order.length){
+	limit = table->order.length;//no more matches than records
+    }
+    if(limit <= 0 || numwords == 0 || prog->nomatch){
+	return 1;
+    }
+    last.value = *value;
+    last.slot = *slot;
+    heap = malloc(limit * sizeof(struct topentry));
+    if(heap == NULL){
+	return -1;
+    }
+    if(!prog->descending && column->index == INDEX_SORTED){
+	//the index is in (value, slot) order already, so the walk stops at limit
+	for(j = 0; j < prog->count; j++){
+	    values[j] = LOAD_ACQUIRE(store->values[prog->preds[j].column]);
 	}
-	if(received[i] == '&'){
-	    if(commandflag == true){
-		commandflag = false;
-		command[j] = '\0';
-		j=0;
+	x = resume ? intindex_seek(&table->sorted[prog->order], last.value)
+	    : LOAD_ACQUIRE(table->sorted[prog->order].header->forward[0]);
+	for(; x != NULL && !more; x = LOAD_ACQUIRE(x->forward[0])){
+	    entry.value = x->value;
+	    entry.slot = x->slot;
+	    if((resume && !top_before(prog, &last, &entry)) || entry.slot >= slots
+	       || !query_test(prog, values, entry.slot) || (entry.row = LOAD_ACQUIRE(rows[entry.slot])) == NULL){
+		continue;
 	    }
-	    else commandflag = true;
-	}
-	else if(received[i] == '^'){
-	    if(nameflag == true){
-		nameflag = false;
-		tablename[j] = '\0';
-		j=0;
+	    if(count == limit){
+		more = true;
 	    }
-	    else nameflag = true;
-	}
-	else if(received[i] == '*'){
-			if(keyflag == true){
-			    keyflag = false;
-			keyname[j] = '\0';
-			j=0;
-			}
-			else keyflag = true;
-	}
-	else if(received[i] == '@'){
-	    valueflag = true;
-	    if(atflag == false){
-		atflag = true;
-		value[j] = '@';
-		j++;
+	    else {
+		heap[count++] = entry;
 	    }
-	    //value[j] = received[i];
-	    //j++;
 	}
-	else if(received[i] == '~'){
-	    if(counterflag == true){
-				counterflag = false;
-				tempcounter[j] = '\0';
-				j=0;
+    }
+    else {
+	//a bounded heap of the first limit matches, O(n log limit)
+	for(from = 0; from < numwords; from = to){
+	    to = from + MORSEL_WORDS < numwords ? from + MORSEL_WORDS : numwords;
+	    for(w = from; w < to; w++){
+		match[w - from] = __atomic_load_n(&valid[w], __ATOMIC_ACQUIRE);
 	    }
-	    else {
-		valueflag = false;
-		value[j-1] = '\0';
-		j = 0;	
-		counterflag = true;
-		nocounter = false;
+	    query_filter(table, prog, slots, from, to, match);
+	    for(w = from; w < to; w++){
+		for(bits = match[w - from]; bits != 0; bits &= bits - 1){
+		    entry.slot = w * BITMAP_WORD_BITS + __builtin_ctzl(bits);
+		    if((entry.row = LOAD_ACQUIRE(rows[entry.slot])) == NULL){
+			continue;//deleted since the bitmap was copied
+		    }
+		    entry.value = row_int(entry.row->row, column);
+		    if(resume && !top_before(prog, &last, &entry)){
+			continue;
+		    }
+		    if(count < limit){
+			heap[count] = entry;
+			top_up(prog, heap, count++);
+			continue;
+		    }
+		    more = true;
+		    if(top_before(prog, &entry, &heap[0])){
+			heap[0] = entry;
+			top_down(prog, heap, count, 0);
+		    }
+		}
 	    }
 	}
-	i++;
+	//heapsort, the entry sorting last goes to the end first
+	for(i = count - 1; i > 0; i--){
+	    tmp = heap[0];
+	    heap[0] = heap[i];
+	    heap[i] = tmp;
+	    top_down(prog, heap, i, 0);
+	}
     }
-    if(nocounter == true){
-	i = 0;
-	while(value[i] != '?'){
-	    i++;
+    for(i = 0; i < count; i++){
+	if(found != NULL){
+	    found[keys->count] = heap[i].row;
 	}
-	value[i+1] = '\0';
+	keylist_add(keys, heap[i].row->name);
     }
-    *counter = atoi(tempcounter);
-    //value[j] = '\0';
-    return 0;
+    if(count > 0){
+	*value = heap[count - 1].value;
+	*slot = heap[count - 1].slot;
+    }
+    free(heap);
+    return !more;
 }
 
-int encode_line(char *type, char *status, char *statustwo, char *retline)
+/* Mutex guarding the QUERY result cache */
+static pthread_mutex_t cacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct cacheentry *querycache;
+static unsigned long querycache_size;//0 while the cache is off
+
+void querycache_init(unsigned long entries)
 {
-    /*encodes a line to be sent back to the client containing
-      appropriate arguments*/
-    sprintf(retline, "%s %s %s", type, status, statustwo);
-    return 0;
+    //calloc leaves every entry unused with an empty keylist
+    querycache = entries > 0 ? calloc(entries, sizeof(struct cacheentry)) : NULL;
+    querycache_size = querycache != NULL ? entries : 0;
 }
 
-int encode_retval(struct column column[10], char *retval, int limit)
+static int predicate_order(const void *a, const void *b)
 {
-    //encodes values from the columns into a line for further usage
-    char tempstring[1024];
-    int j=0;
-    while(j<limit){
-	strcat(retval, column[j].typename);
-	strcat(retval, " ");
-	if(column[j].flag == true){
-	    //char
-	    strcat(retval, column[j].strval);
-	}
-	else {
-	    //int
-	    sprintf(tempstring, "%d", column[j].intval);
-	    strcat(retval, tempstring);
+    const struct predicate *x = a;
+    const struct predicate *y = b;
+    if(x->column != y->column){
+	return x->column - y->column;
+    }
+    if(x->operator != y->operator){
+	return x->operator - y->operator;
+    }
+    return (x->value > y->value) - (x->value < y->value);
+}
+
+//Sorts the predicates of prog into preds and returns the entry a page
+//of them is cached in
+static struct cacheentry* querycache_slot(int index, struct queryprog *prog, unsigned int first, int limit, struct predicate *preds)
+{
+    //FNV-1a over the fields, struct predicate has padding
+    unsigned int hash = 2166136261u;
+    int j;
+    memcpy(preds, prog->preds, prog->count * sizeof(struct predicate));
+    qsort(preds, prog->count, sizeof(struct predicate), predicate_order);
+    hash = (hash ^ (unsigned int)index) * 16777619u;
+    hash = (hash ^ first) * 16777619u;
+    hash = (hash ^ (unsigned int)limit) * 16777619u;
+    for(j = 0; j < prog->count; j++){
+	hash = (hash ^ (unsigned int)preds[j].column) * 16777619u;
+	hash = (hash ^ (unsigned char)preds[j].operator) * 16777619u;
+	hash = (hash ^ (unsigned int)preds[j].value) * 16777619u;
+    }
+    return &querycache[hash % querycache_size];
+}
+
+int querycache_get(struct keylist *keys, struct citytable *table, int index, unsigned long version,
+		   struct queryprog *prog, unsigned int *next, int limit)
+{
+    struct predicate preds[MAX_COLUMNS_PER_TABLE];
+    struct cacheentry *entry;
+    int done = -1;
+    int i, j;
+    if(querycache_size == 0){
+	return -1;
+    }
+    entry = querycache_slot(index, prog, *next, limit, preds);
+    pthread_mutex_lock(&cacheMutex);
+    if(entry->used && entry->table == index && entry->version == version && entry->first == *next
+       && entry->limit == limit && entry->count == prog->count){
+	for(j = 0; j < prog->count; j++){
+	    if(predicate_order(&entry->preds[j], &preds[j]) != 0){
+		break;
+	    }
 	}
-	if(j<limit-1){
-	    strcat(retval, ",");
+	if(j == prog->count){
+	    for(i = 0; i < entry->keys.count; i++){
+		keylist_add(keys, entry->keys.keys[i]);
+	    }
+	    *next = entry->next;
+	    done = entry->done;
 	}
-	j++;//increment column counter
     }
-    strcat(retval, " END");
-    return 0;
+    pthread_mutex_unlock(&cacheMutex);
+    __atomic_add_fetch(done == -1 ? &table->cachemisses : &table->cachehits, 1, __ATOMIC_RELAXED);
+    return done;
 }
 
-int query_argument(struct queryarg *querylist, char *values)
+void querycache_put(struct keylist *keys, int index, unsigned long version, struct queryprog *prog,
+		    unsigned int first, unsigned int next, int done, int limit)
 {
-    bool firstflag = false;
-    bool secondflag = false;
+    struct predicate preds[MAX_COLUMNS_PER_TABLE];
+    struct cacheentry *entry;
+    int i;
+    if(querycache_size == 0){
+	return;
+    }
+    entry = querycache_slot(index, prog, first, limit, preds);
+    //a colliding page is replaced, the newest is the likeliest asked again
+    pthread_mutex_lock(&cacheMutex);
+    entry->used = true;
+    entry->table = index;
+    entry->version = version;
+    entry->count = prog->count;
+    memcpy(entry->preds, preds, prog->count * sizeof(struct predicate));
+    entry->first = first;
+    entry->limit = limit;
+    entry->next = next;
+    entry->done = done;
+    entry->keys.count = 0;
+    for(i = 0; i < keys->count; i++){
+	keylist_add(&entry->keys, keys->keys[i]);
+    }
+    pthread_mutex_unlock(&cacheMutex);
+}
+
+int scan_argument(char *values, char *mode, char *first, char *last, int *max_keys)
+{
+    //#<max_keys>#&<mode>&*<first>**<last>*
     bool intflag = false;
     bool opflag = false;
+    bool keyflag = false;
     char tempint[1024];
-    int i = 0; //values counter
-    int j = 0; //array y index
-    int k = 0; //array x index
-    while(values[i] != '\0') {
-	if(firstflag == true && values[i] != '@') {
-	    querylist->firstarg[j][k] = values[i];
-	    k++;
-	}
-	else if(secondflag == true && values[i] != '$'){
-	    querylist->secondarg[j][k] = values[i];
+    char *dest = first;
+    int i = 0;//values counter
+    int k = 0;//dest counter
+    first[0] = '\0';
+    last[0] = '\0';
+    *mode = '\0';
+    while(values[i] != '\0'){
+	if(intflag == true && values[i] != '#'){
+	    tempint[k] = values[i];
 	    k++;
 	}
 	else if(opflag == true && values[i] != '&'){
-	    querylist->operator[j] = values[i];
+	    *mode = values[i];
 	}
-	else if(intflag == true && values[i] != '#'){
-	    tempint[k] = values[i];
-	    k++;
-	}
-	if(values[i] == '@'){
-	    if(firstflag == true){
-		firstflag = false;
-		querylist->firstarg[j][k] = '\0';
-		k = 0;
+	else if(keyflag == true && values[i] != '*'){
+	    if(k < MAX_KEY_LEN){
+		dest[k] = values[i];
+		k++;
 	    }
-	    else firstflag = true;
 	}
-	else if(values[i] == '#'){
+	if(values[i] == '#'){
 	    if(intflag == true){
 		intflag = false;
 		tempint[k] = '\0';
 		k = 0;
-		querylist->max_keys = atoi(tempint);
+		*max_keys = atoi(tempint);
 	    }
 	    else intflag = true;
 	}
 	else if(values[i] == '&'){
-	    if(opflag == true){
-		opflag = false;
-	    }
-	    else opflag = true;
+	    opflag = !opflag;
 	}
-	else if(values[i] == '!'){
-	    j++;
-	}
-	else if(values[i] == '$'){
-	    if(secondflag == true){
-		secondflag = false;
-		querylist->secondarg[j][k] = '\0';
+	else if(values[i] == '*'){
+	    if(keyflag == true){
+		keyflag = false;
+		dest[k] = '\0';
 		k = 0;
+		dest = last;//second key ends the range
 	    }
-	    else secondflag = true;
+	    else keyflag = true;
 	}
 	i++;
     }
-    return j+1;//number of query arguments
+    if(*mode != 'R' && *mode != 'P'){
+	return -1;
+    }
+    return 0;
 }
 
-int query_compare(struct queryarg *querylist, struct city *target, int *querynum)
-{
-    //what to do?
-    //travel through querylist and find matching name (firstarg) first
-    //then fetch value and flag from that column
-    //do the operation according to query operator
-    //finally return result (true = 1, false = 0)
-    //Possible Errors:
-    //1. mismatched type (parse by individual characters)
-    //2. duplicate (handled using column-by-column comparison)
-    //3. wrong operator (if type is not int and '<' or '>' is used, return error.)
-    int i = 0;//columnlist counter
-    int j = 0;//querynum counter
-    int tempint;
-    bool matchflag = true;//to be set false if mismatch occurs
-    printf("target name: %s\n", target->name);
-    while(i < target->numocolumns) {
-	
-	//puts("i<target->numocolumns");
-	//traverse until the end of the columnlist
-	if(j > *querynum){
-	    //puts("increment i, reset j");
-	    printf("target name: %s\n", target->columnlist[i].typename);
-	    //end of querylist reached
-	    i++;//increment columnlist
-	    j = 0;//reset querynum counter
-	}
-	//printf("pre-comparison, target typename: %s\n", target->columnlist[i].typename);
-	if(strcmp(querylist->firstarg[j], target->columnlist[i].typename) == 0){
-	    //matching typename
-	    if(target->columnlist[i].flag == true){
-		//string comparison
-		puts("string comparison");
-		if(querylist->operator[j] != '='){
-		    //invalid operator ('=' only for strings)
-		    puts("invalid operand");
-		    return -1;
-		}
-		else {
-		    if(strcmp(querylist->secondarg[j], target->columnlist[i].strval) == 0){
-			//comparison successful
-			//do nothing
-			puts("string comparison successful");
-		    }
-		    else {
-			//comparison failed
-			puts("string comparison failed");
-			matchflag = false;
-		    }
-		}
-	    }
-	    else if(target->columnlist[i].flag == false) {
-		//int comparison
-		tempint = atoi(querylist->secondarg[j]);
-		printf("int comparison, tempint = %d\n", tempint);
-		printf("target intval = %d\n", target->columnlist[i].intval);
-		if(querylist->operator[j] == '<'){
-		    //less than secondarg
-		    if(target->columnlist[i].intval >= tempint) {
-			matchflag = false;
-			puts("int comparison < failed");
-		    }
-		    else {
-			//do nothing
-			puts("int comparison < successful");
-		    }
-		}
-		else if(querylist->operator[j] == '>'){
-		    //greater than secondarg
-		    if(target->columnlist[i].intval <= tempint) {
-			matchflag = false;
-			puts("int comparison > failed");
-		    }
-		    else {
-			//do nothing
-			puts("int comparison > successful");
-		    }
-		}
-		else if(querylist->operator[j] == '='){
-		    //equal to secondarg
-		    if(target->columnlist[i].intval != tempint) {
-			matchflag = false;
-			puts("int comparison = failed");
-		    }
-		    else {
-			//do nothing
-			puts("int comparison = successful");
-		    }
-		}
-	    }
-	    else matchflag = false;
-	}
-	else {
-	    // no match, move on
-	    //j++;//increment querylist index
-	    //printf("very weird error indeed.\n");
-	    //rinse and repeat
-	}
-	j++;
-    }
-    if(matchflag == true){
-	printf("matchflag correct\n");
-	return 1;//all query
-    } 
-    else return 0;
-}
-
-int query_write(char keylist[1000][1024], struct queryarg *querylist, struct city *head, int *limit, int *querynum)
-{
-    int status= 0;
-    int i = 0;//keylist counter
-    printf("limit is %d\n", *limit);
-    //*limit++;
-    //takes input arguments and compare columns in the table according to it
-    while(head != NULL) {
-	printf("head name: %s\n", head->name);
-	status = query_compare(querylist, head, querynum);
-	printf("status = %d\n", status);
-	if(status == -1){
-	    //error occurred
-	    printf("error occurred\n");
-	    return -1;
-	}
-	else if(status == 1 && i < *limit) {
-	    printf("i is less than limit\n");
-	    printf("head->name: %s\n", head->name);
-	    printf("keylist[%d]: %s\n", i, keylist[i]);
-	    if(head->name[0] != '\0' || head->name[0] != ' '){
-	       	strncpy(keylist[i], head->name, sizeof(keylist[i]));
-		printf("written to keylist\n");
-		i++;
-	    }
+int scan_write(struct keylist *keys, struct citytable *table, char mode, char *first, char *last, int limit)
+{
+    //appends keys of a range ('R') or prefix ('P') scan in key order
+    struct skipnode *x = skiplist_seek(&table->order, first);
+    struct city *node;
+    size_t prefixlen = strlen(first);
+    while(x != NULL && keys->count < limit){
+	node = LOAD_ACQUIRE(x->city);
+	if(mode == 'P' && strncmp(node->name, first, prefixlen) != 0){
+	    break;
 	}
-	else {
-	    // do nothing
-	    printf("do nothing\n");
+	if(mode == 'R' && last[0] != '\0' && strcmp(node->name, last) > 0){
+	    break;
 	}
-	head = head->next;
-	printf("move on to next head\n");
+	keylist_add(keys, node->name);
+	x = LOAD_ACQUIRE(x->forward[0]);
     }
-    return 0;
+    return keys->count;//number of keys written
 }
 
 int check_column(struct config_params *param)
@@ -985,6 +4001,68 @@ int queryparse(char *in, char *out)
     return stat;//valid params
 }
 
+//Case insensitive search for word, as a whole word, in in
+static char* find_clause(char *in, const char *word)
+{
+    size_t len = strlen(word);
+    char *at;
+    for(at = in; *at != '\0'; at++){
+	if(strncasecmp(at, word, len) == 0 && (at == in || at[-1] == ' ' || at[-1] == ',')
+	   && (at[len] == ' ' || at[len] == '\0')){
+	    return at;
+	}
+    }
+    return NULL;
+}
+
+int orderparse(char *in, char *out)
+{
+    //ORDER BY <column> [ASC|DESC] [LIMIT <n>]
+    char *order = find_clause(in, "ORDER");
+    char *limit = find_clause(in, "LIMIT");
+    char by[1024];
+    char column[1024];
+    char sort[1024];
+    char direction = '<';
+    char rest;
+    char *end;
+    long n = 0;
+    int fields;
+    if(limit != NULL && order != NULL && limit < order){
+	return -1;//LIMIT goes last
+    }
+    if(limit != NULL){
+	n = strtol(limit + strlen("LIMIT"), &end, 10);
+	if(end == limit + strlen("LIMIT") || n < 0 || n > INT_MAX || strspn(end, " ") != strlen(end)){
+	    return -1;
+	}
+	*limit = '\0';
+    }
+    if(order != NULL){
+	fields = sscanf(order + strlen("ORDER"), " %1023s %1023s %1023s %c", by, column, sort, &rest);
+	if(fields < 2 || fields > 3 || strcasecmp(by, "BY") != 0 || strpbrk(column, "%~,") != NULL){
+	    return -1;
+	}
+	if(fields == 3){
+	    if(strcasecmp(sort, "DESC") == 0){
+		direction = '>';
+	    }
+	    else if(strcasecmp(sort, "ASC") != 0){
+		return -1;
+	    }
+	}
+	sprintf(out + strlen(out), "%%%s%%%c", column, direction);
+	*order = '\0';
+    }
+    if(limit != NULL){
+	sprintf(out + strlen(out), "~%ld~", n);
+    }
+    //the predicates before the clauses lose their trailing separator
+    for(end = in + strlen(in); end > in && (end[-1] == ' ' || end[-1] == ','); end--);
+    *end = '\0';
+    return 0;
+}
+
 int argparse(char *in, char *out)
 {
     char firstarg[1024];
@@ -997,7 +4075,6 @@ int argparse(char *in, char *out)
     bool secondflag = false;
     bool opflag = false;
     bool intflag = false;
-    bool floatflag = false;
     char tempout[1024];
 
     while(in[i] != '\0'){
@@ -1012,16 +4089,13 @@ int argparse(char *in, char *out)
 		//secondarg[j] = in[i];
 		//j++;
 		beginflag = true;
-		if(in[i] == '-' || (in[i] <= '9' && in[i] >= '0')){
+		if(in[i] == '-' || in[i] == '.' || (in[i] <= '9' && in[i] >= '0')){
 		    intflag = true;
 		}
 		else intflag = false;
 	    }
 	}
 	if(secondflag == true && beginflag == true){
-	    if(in[i] == '.'){
-		floatflag = true;
-	    }
 	    secondarg[j] = in[i];
 	    j++;
 	}
@@ -1057,7 +4131,7 @@ int argparse(char *in, char *out)
 	sprintf(tempout, "@%s@&%c&$%s$!", firstarg, operator_sign, secondarg);
     }
     else if(intflag == false){
-	if(operator_sign == '=' && floatflag == false){
+	if(operator_sign == '='){
 	sprintf(tempout, "@%s@&%c&$%s$!", firstarg, operator_sign, secondarg);
 	}
 	else return -1;//return invalid params
@@ -1120,19 +4194,74 @@ int decode_queryret(char *ret_buffer, char **keylist)
     return num_match-1;
 }
 
-void encode_queryret(int num_match, char keylist[1000][1024], char *retstring)
+void encode_queryret(char *command, int num_match, struct keylist *keys, char *retstring)
 {
-    //same encoding as above
-    int i = 1;
+    //same encoding as above, num_match counts only the keys that fit
+    char header[64];
+    char encoded[MAXLEN];
+    size_t used;
+    int i = 0;
+    encoded[0] = '\0';
+    used = snprintf(header, sizeof(header), "&%s&$SUCCESS$#%d#", command, num_match);
+    while(i < keys->count){
+	if(used + strlen(keys->keys[i]) + 3 >= MAXLEN){
+	    break;//no room left in the reply line
+	}
+	strcat(encoded, "@");
+	strcat(encoded, keys->keys[i]);
+	strcat(encoded, "@!");
+	used += strlen(keys->keys[i]) + 3;
+	i++;
+    }
     cleanstring(retstring);
-    sprintf(retstring, "&QUERY&$SUCCESS$#%d#", num_match);
-    while(keylist[i][0] != '\0'){
-	strcat(retstring, "@");
-	strcat(retstring, keylist[i]);
-	strcat(retstring, "@");
-	strcat(retstring, "!");
+    snprintf(retstring, MAXLEN, "&%s&$SUCCESS$#%d#", command, num_match - (keys->count - i));
+    strncat(retstring, encoded, MAXLEN - 1 - strlen(retstring));
+}
+
+int encode_queryrows(char *command, struct citytable *table, struct city **rows, int count, int *columns, int numcolumns, char *retstring)
+{
+    //#<number_of_matching_keys>#
+    //@<key_name>@~<counter>~$<column> <value>,...$!
+    char encoded[MAXLEN];
+    char row[MAX_CMD_LEN];
+    int i = 0;
+    encoded[0] = '\0';
+    while(i < count){
+	row[0] = '\0';
+	encode_columns(table, rows[i]->row, columns, numcolumns, row);
+	if(strlen(encoded) + strlen(rows[i]->name) + strlen(row) + 48 > MAXLEN){
+	    break;//no room left in the reply line
+	}
+	snprintf(encoded + strlen(encoded), sizeof(encoded) - strlen(encoded), "@%s@~%d~$%s$!", rows[i]->name, rows[i]->counter, row);
 	i++;
     }
+    cleanstring(retstring);
+    sprintf(retstring, "&%s&$SUCCESS$#%d#%s", command, i + 1, encoded);
+    return i;
+}
+
+int decode_queryrows(char *ret_buffer, char **keylist, struct storage_record *records)
+{
+    char *row = strchr(ret_buffer, '#');
+    char *end;
+    int n = 0;
+    if(row == NULL || (row = strchr(row + 1, '#')) == NULL){
+	return 0;
+    }
+    for(row++; row[0] == '@'; row = end + 2){
+	if((end = strchr(row + 1, '@')) == NULL){
+	    break;
+	}
+	memcpy(keylist[n], row + 1, end - row - 1);
+	keylist[n][end - row - 1] = '\0';
+	records[n].metadata[0] = strtoul(end + 2, &row, 10);
+	if(row[0] != '~' || row[1] != '$' || (end = strchr(row + 2, '$')) == NULL){
+	    break;
+	}
+	snprintf(records[n].value, sizeof(records[n].value), "%.*s", (int)(end - row - 2), row + 2);
+	n++;
+    }
+    return n;
 }
 
 void add_equal(char *in)
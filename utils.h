@@ -16,6 +16,7 @@
 #include <netdb.h>
 #include <assert.h>
 #include <pthread.h>
+#include <limits.h>
 #include "storage.h"
 
 /*Custom definitions*/
@@ -23,10 +24,34 @@
 #define Key 'K'
 #define Value 'V'
 #define MAXLEN 1023
+#define MAX_CURSORS 4 //open QUERY cursors per connection
+//Keys per FETCH reply, so that a page always fits in one reply line
+#define CURSOR_PAGE ((MAXLEN - 32) / (MAX_KEY_LEN + 3))
 /*End of custom definitions*/
 
 //////////////////////////// M4 /////////////////////////////////
 
+/**
+ * @brief A QUERY cursor opened by a connection.
+ *
+ * The predicates are kept as sent and compiled again for every page, so
+ * nothing matched is held between FETCHes; next is the first colstore
+ * slot the cursor has not looked at yet. A cursor opened with columns
+ * sends those columns of each matching record along with its key. An
+ * ORDER BY cursor instead resumes after the last key it sent, the one
+ * with value lastvalue in slot next.
+ */
+struct querycursor {
+	bool open;
+	int table;
+	unsigned int next;
+	int lastvalue;
+	unsigned long returned;//keys sent, counted against the LIMIT
+	int numcolumns;//columns a FETCH returns with each key, -1 for keys only
+	int columns[MAX_COLUMNS_PER_TABLE];
+	char predicates[MAXLEN];
+};
+
 struct _ThreadInfo { 
 	struct sockaddr_in clientaddr;
 	socklen_t clientaddrlen; 
@@ -35,8 +60,9 @@ struct _ThreadInfo {
 	
 	FILE *fileptr;
 	struct config_params* params;
-	struct city **headlist;
+	struct citytable *tables;
 	int auth_success;	 
+	struct querycursor cursors[MAX_CURSORS];
 }; 
 typedef struct _ThreadInfo *ThreadInfo; 
 
@@ -99,6 +125,9 @@ static const char CONFIG_COMMENT_CHAR = '#';
 struct column{
     char typename[MAX_STRTYPE_SIZE];
     bool flag; /* char[SIZE]==true, int==false */
+    bool real; /* declared as float, flag is false */
+    int size; /* SIZE of char[SIZE] columns */
+    int index; /* INDEX_* from an "index <table> <column> [bitmap]" line */
     union
     {
 		int intval;
@@ -106,13 +135,27 @@ struct column{
     };
 };
 
+#define TABLEINDEX_MIN_SIZE 16 ///< Fewest buckets of the table name lookup.
+
+/**
+ * @brief Open addressing lookup from table name to tablelist index.
+ *
+ * Built once after the config file is parsed and never changed
+ * afterwards, so connection threads read it without locking.
+ */
+struct tableindex{
+    int *slot;//tablelist index + 1, 0 when empty
+    unsigned int *hash;
+    unsigned int size;//power of two, at least twice num_tables
+};
+
 /**
  * @brief A struct to store config parameters.
  */
 struct config_params {
     int option;
     int num_tables;
-    int num_columns[MAX_TABLES];
+    int *num_columns;
     /// The hostname of the server.
     char server_host[MAX_HOST_LEN];
     
@@ -125,9 +168,27 @@ struct config_params {
     /// The storage server's encrypted password
     char password[MAX_ENC_PASSWORD_LEN];
     
-    // Table names
-    char tablelist[MAX_TABLES][MAX_TABLE_LEN];
-    struct  column columnlist[MAX_TABLES][MAX_COLUMNS_PER_TABLE];
+    // Table names, grown by config_reserve() while parsing
+    char (*tablelist)[MAX_TABLE_LEN];
+    struct  column (*columnlist)[MAX_COLUMNS_PER_TABLE];
+    int table_capacity;
+    struct tableindex tableindex;
+
+    /// Optional quotas from the config file, 0 means unlimited.
+    int max_tables;
+    unsigned long max_records;
+
+    /// Memory caps in bytes, 0 means unlimited; see evict_cities().
+    unsigned long max_memory;
+    unsigned long *memory_caps;//per table, grown with tablelist
+    int eviction;
+
+    /// QUERY threads (0, the default, for one per CPU) and the records above which a scan is split.
+    int query_threads;
+    unsigned long parallel_rows;
+
+    /// QUERY result cache entries, 0 to disable the cache.
+    unsigned long query_cache;
     
     /// The directory where tables are stored.
     //char data[MAX_PATH_LEN];
@@ -135,12 +196,388 @@ struct config_params {
 
 /*Custom struct*/
 
+#define EVICT_LRU 0	///< Least recently read or written record first.
+#define EVICT_RANDOM 1	///< Any record.
+#define EVICT_TTL 2	///< Least recently written record first.
+
+#define EVICTION_SAMPLES 5 ///< Records compared to pick one to evict.
+#define EVICTION_PER_SET 4 ///< Records one SET may evict, so a table over its cap shrinks.
+
+#define COLUMN_INT 0
+#define COLUMN_STR 1
+#define COLUMN_FLOAT 2 ///< Stored as float_key(), so it sorts and compares like an int column.
+
+#define INDEX_NONE 0
+#define INDEX_SORTED 1 ///< Skiplist of (value, slot) over an int column.
+#define INDEX_HASH 2 ///< Posting list per interned value of a string column.
+#define INDEX_BITMAP 3 ///< Compressed slot bitmap per interned value of a string column.
+
+struct schemacolumn{
+    char name[MAX_STRTYPE_SIZE];
+    int type;
+    int size;//bytes taken in a row
+    int offset;//position in a row
+    int length;//max characters of a string column
+    int index;//INDEX_NONE or the kind of secondary index kept
+};
+
+/**
+ * @brief Column names, types and row offsets of a table.
+ *
+ * Built once from the config file; records only store the packed
+ * values and are read through the schema of their table.
+ */
+struct schema{
+    int numcolumns;
+    int rowsize;
+    struct schemacolumn columns[MAX_COLUMNS_PER_TABLE];
+};
+
+/// Upper bound of schema.rowsize: ints, floats and string handles are 4 bytes each.
+#define MAX_ROW_SIZE (MAX_COLUMNS_PER_TABLE * 4)
+
+static inline int row_int(const char *row, const struct schemacolumn *column)
+{
+    return *(const int *)(row + column->offset);
+}
+
+static inline unsigned int row_handle(const char *row, const struct schemacolumn *column)
+{
+    return *(const unsigned int *)(row + column->offset);
+}
+
+/**
+ * @brief The int whose order is that of value, for a float column.
+ *
+ * Negative floats have their magnitude bits flipped, so the colstore
+ * kernels and sorted indexes of int columns work on floats unchanged.
+ */
+static inline int float_key(float value)
+{
+    int bits;
+    if(value == 0.0f){
+	value = 0.0f;//-0 equals 0
+    }
+    memcpy(&bits, &value, sizeof(bits));
+    return bits < 0 ? bits ^ INT_MAX : bits;
+}
+
+static inline float key_float(int key)
+{
+    float value;
+    key = key < 0 ? key ^ INT_MAX : key;
+    memcpy(&value, &key, sizeof(value));
+    return value;
+}
+
 struct city{
 	int counter;
     char name[MAX_KEY_LEN+1];//key
-    int numocolumns;
-    struct column columnlist[MAX_COLUMNS_PER_TABLE];//values
-    struct city *next;
+    unsigned int hash;//precomputed hash of name
+    unsigned int slot;//position in the table colstore
+    unsigned long atime;//access clock of the last read or write
+    unsigned long mtime;//access clock of the last write
+    struct city *next;//insertion order
+    struct city *prev;
+    struct city *hnext;//hash chain
+    char row[];//values, laid out by the table schema
+};
+
+/**
+ * @brief Hash index over the keys of one table.
+ *
+ * Two bucket arrays are kept so that growing the index can be spread
+ * over many SET commands: while rehashing, new keys go to table[1] and
+ * every write moves a bucket from table[0] until it is empty.
+ */
+struct cityhash{
+    struct city **table[2];
+    unsigned long size[2];
+    unsigned long used[2];
+    long rehashidx;//-1 when not rehashing
+    unsigned long seq;//odd while a writer is changing the index
+};
+
+/// Loads and stores of pointers that lock-free readers follow.
+#define LOAD_ACQUIRE(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+
+#define EBR_SLOTS (MAX_CONNECTIONS + 1) ///< Readers inside the tables at once.
+#define EBR_RESERVE 256 ///< Retire nodes kept for when malloc fails.
+
+/**
+ * @brief Memory unlinked by a writer, freed once no reader can see it.
+ *
+ * GET, QUERY, SCAN and STATS read the tables without taking setMutex,
+ * inside ebr_enter()/ebr_exit(). Writers unlink records, index nodes,
+ * interned strings and replaced arrays and hand them to ebr_retire();
+ * ebr_collect() advances the global epoch and runs reclaim() for what
+ * was retired before the oldest epoch a reader is still in.
+ */
+struct ebr_retired{
+    struct ebr_retired *next;
+    unsigned long epoch;
+    void (*reclaim)(void *owner, void *ptr);
+    void *owner;
+    void *ptr;
+};
+
+#define SLAB_PAGE_SIZE (64 * 1024) ///< Bytes carved into chunks at a time.
+#define SLAB_CLASSES 20		///< Number of chunk size classes.
+#define SLAB_MIN_CHUNK 64	///< Chunk size of the smallest class.
+
+struct slabpage{
+    struct slabpage *next;
+    size_t chunksize;//0 for allocations too big for any class
+    size_t bytes;
+};
+
+struct slabclass{
+    size_t size;
+    struct slabpage *pages;
+    void *freelist;//freed chunks, linked through their first word
+    char *carve;//uncarved part of the newest page
+    char *carve_end;
+    unsigned long total;//chunks carved so far
+    unsigned long used;//chunks handed out
+};
+
+/**
+ * @brief Per-table allocator for records and index nodes.
+ *
+ * Requests are rounded up to a size class; each class carves chunks
+ * out of SLAB_PAGE_SIZE pages and keeps freed chunks on a free list,
+ * so records of one table sit next to each other and are reused in
+ * place. Everything is returned to the system by slab_release().
+ */
+struct slab{
+    struct slabclass classes[SLAB_CLASSES];
+    struct slabpage *large;//allocations bigger than the largest class
+    unsigned long large_bytes;
+    unsigned long page_bytes;
+};
+
+#define SKIPLIST_MAXLEVEL 16 ///< Max levels of a skiplist.
+
+struct skipnode{
+    struct city *city;
+    int level;
+    struct skipnode *forward[];
+};
+
+/**
+ * @brief Ordered index over the keys of one table.
+ */
+struct skiplist{
+    struct slab *slab;
+    struct skipnode *header;
+    int level;
+    unsigned long length;
+    unsigned long bytes;//held by the nodes
+};
+
+struct strentry{
+    struct strentry *hnext;//hash chain
+    unsigned int hash;
+    unsigned int refcount;//rows holding this value
+    unsigned int handle;
+    unsigned int len;
+    char str[];
+};
+
+#define STRHEAP_INITIAL_SIZE 64 ///< Buckets and handles of a new string heap.
+
+/**
+ * @brief Interned values of the string columns of one table.
+ *
+ * Rows hold a 4 byte handle per string column and equal values share
+ * one refcounted entry, so string equality is a handle compare. Entries
+ * live in the table slab; handle 0 is never given out.
+ */
+struct strheap{
+    struct slab *slab;
+    struct strentry **buckets;
+    unsigned long size;
+    unsigned long used;//distinct values stored
+    unsigned long bytes;//held by the entries
+    struct strentry **entries;//by handle
+    unsigned int *freehandles;
+    unsigned int numfree;
+    unsigned int high;//handles given out so far, including 0
+    unsigned int capacity;
+    unsigned long seq;//odd while a writer is changing the buckets
+};
+
+#define BITMAP_WORD_BITS (8 * sizeof(unsigned long))
+#define COLSTORE_INITIAL_SLOTS 64 ///< Must be a multiple of BITMAP_WORD_BITS.
+#define ZONE_SLOTS 1024 ///< Slots summed up by one zone map entry, a multiple of BITMAP_WORD_BITS.
+#define COLSTORE_ZONES(capacity) (((capacity) + ZONE_SLOTS - 1) / ZONE_SLOTS)
+
+/**
+ * @brief Columnar copy of the columns of one table.
+ *
+ * Every record owns a slot; values[j][slot] mirrors column j of its
+ * row (the handle for string columns) and bit slot of valid is set
+ * while the slot is in use, so QUERY can filter predicates with tight
+ * loops over the arrays. zonemin[j] and zonemax[j] bound the values of
+ * each block of ZONE_SLOTS slots: a SET only widens them, so a scan may
+ * skip a block a predicate can't match in; the planner statistics
+ * tighten them again.
+ */
+struct colstore{
+    int *values[MAX_COLUMNS_PER_TABLE];
+    int *zonemin[MAX_COLUMNS_PER_TABLE];//INT_MAX for a block no record was in
+    int *zonemax[MAX_COLUMNS_PER_TABLE];
+    struct city **rows;//record owning each slot
+    unsigned long *valid;//bitmap of slots in use
+    unsigned int *freeslots;//slots released by deletes
+    unsigned int numfree;
+    unsigned int high;//slots handed out so far
+    unsigned int capacity;
+};
+
+struct intnode{
+    int value;
+    unsigned int slot;//colstore slot of the record
+    int level;
+    struct intnode *forward[];
+};
+
+/**
+ * @brief Sorted secondary index over one int column.
+ *
+ * A skiplist of (value, slot) pairs kept in step with the records by
+ * insert_city(), modify_city() and delete_city(), so QUERY answers a
+ * '<', '>' or '=' predicate by walking only the matching range.
+ */
+struct intindex{
+    struct slab *slab;
+    struct intnode *header;//NULL when the column has no index
+    int level;
+    unsigned long length;
+    unsigned long bytes;//held by the nodes
+};
+
+struct postlist{
+    unsigned int *slots;//colstore slots of the records holding the value
+    unsigned int count;
+    unsigned int capacity;
+};
+
+/**
+ * @brief Hash index over one string column.
+ *
+ * Values are already hashed and interned by the strheap, so the index
+ * is a posting list per strheap handle; an equality predicate costs a
+ * strheap lookup plus the matches. pos[slot] is where a slot sits in
+ * its list so removal is a swap with the last entry.
+ */
+struct strindex{
+    struct postlist *lists;//by strheap handle, NULL when the column has no index
+    unsigned int numlists;
+    unsigned int *pos;//by colstore slot, only used by writers
+    unsigned int numpos;
+    unsigned long bytes;//held by the lists
+};
+
+#define STATS_BUCKETS 16 ///< Equi-depth histogram buckets per column.
+#define STATS_SAMPLE 4096 ///< Records sampled for the histograms and distinct counts.
+#define STATS_STALE 10 ///< Statistics are rebuilt once 1/STATS_STALE of the records changed.
+#define STATS_MIN_CHANGES 64 ///< Changes always allowed before a rebuild.
+#define PLAN_INDEX_SHARE 8 ///< An index leads only below 1/PLAN_INDEX_SHARE of the records.
+
+/**
+ * @brief Planner statistics of one column.
+ *
+ * min and max are exact; distinct and the bucket bounds come from a
+ * sample. Each of the STATS_BUCKETS buckets between two bounds holds
+ * about as many records. Float columns are kept as float keys, string
+ * columns only have distinct.
+ */
+struct colstats{
+    int min;
+    int max;
+    unsigned long distinct;
+    int bounds[STATS_BUCKETS + 1];
+};
+
+/**
+ * @brief Planner statistics of one table, see stats_refresh().
+ */
+struct tablestats{
+    unsigned long rows;
+    unsigned long version;//table version they were taken at
+    struct colstats columns[MAX_COLUMNS_PER_TABLE];
+};
+
+#define CONTAINER_SLOTS 65536 ///< Colstore slots covered by one bitmap index container.
+#define CONTAINER_WORDS (CONTAINER_SLOTS / BITMAP_WORD_BITS)
+#define CONTAINER_ARRAY_MAX 4096 ///< Entries an array container takes before it turns into a bitmap.
+
+struct slotarray{
+    unsigned int count;
+    unsigned short low[];//sorted slot % CONTAINER_SLOTS
+};
+
+/**
+ * @brief Slots of one block of CONTAINER_SLOTS holding a value.
+ *
+ * As in roaring bitmaps, a sparse block is a sorted array, replaced by
+ * a copy on every change, and one with more than CONTAINER_ARRAY_MAX
+ * entries a plain bitmap changed in place. Readers load array before
+ * bits and use bits when it is set.
+ */
+struct container{
+    struct slotarray *array;
+    unsigned long *bits;
+};
+
+struct valuebitmap{
+    struct container *blocks;//by slot / CONTAINER_SLOTS
+    unsigned int numblocks;
+    unsigned long count;//slots set
+};
+
+/**
+ * @brief Bitmap index over one string column of few distinct values.
+ *
+ * A compressed bitmap of colstore slots per strheap handle. QUERY ANDs
+ * the bitmaps of the '=' predicates on such columns into its match
+ * words, so only the records holding every value are read.
+ */
+struct bitmapindex{
+    struct valuebitmap *values;//by strheap handle, NULL when the column has no index
+    unsigned int numvalues;
+    unsigned long bytes;//held by the containers
+};
+
+struct citytable{
+    struct schema schema;
+    struct slab slab;
+    struct city *head;
+    struct city *tail;
+    struct cityhash index;
+    struct skiplist order;//keys in strcmp order
+    struct colstore columns;
+    struct strheap strings;
+    struct intindex sorted[MAX_COLUMNS_PER_TABLE];//by schema column
+    struct strindex hashed[MAX_COLUMNS_PER_TABLE];
+    struct bitmapindex bitmaps[MAX_COLUMNS_PER_TABLE];
+    unsigned long memory;//bytes held by the records and their indexes
+    unsigned long evicted;//records removed to stay under a memory cap
+    unsigned long version;//bumped by every SET, QUERY cache entries of older ones are stale
+    unsigned long cachehits;
+    unsigned long cachemisses;
+    struct tablestats *stats;//NULL before the first SET
+};
+
+/**
+ * @brief Growable list of the keys matched by QUERY or SCAN.
+ */
+struct keylist{
+    char (*keys)[MAX_KEY_LEN+1];
+    int count;
+    int capacity;
 };
 
 struct queryarg {
@@ -148,6 +585,95 @@ struct queryarg {
     char secondarg[MAX_COLUMNS_PER_TABLE][1024];
     char operator[MAX_COLUMNS_PER_TABLE];
     int max_keys;
+    char orderby[1024];//ORDER BY column, empty for none
+    char direction;//'<' ascending, '>' descending
+    int limit;//LIMIT, -1 for none
+};
+
+struct predicate{
+    int column;//position in the table schema
+    char operator;//'<', '>' or '='
+    int value;//int constant, or strheap handle for string columns
+    unsigned long estimate;//records expected to pass, ULONG_MAX without statistics
+};
+
+/**
+ * @brief QUERY predicates compiled against the schema of one table.
+ *
+ * Built once per request by query_compile(): columns are resolved,
+ * int constants parsed and string constants looked up in the strheap,
+ * so query_write() runs it without string work. The lead predicate, if
+ * any, is answered from an index and the others are checked against
+ * the colstore values of its matches; otherwise the colstore is scanned.
+ * With statistics the predicates are ordered by estimated matches, most
+ * selective first, and an index leads only if it is selective enough.
+ */
+struct queryprog{
+    int count;
+    int lead;//predicate answered from an index, -1 to scan the colstore
+    bool nomatch;//a string constant no record holds
+    unsigned long estimate;//records expected to match, ULONG_MAX without statistics
+    int order;//int or float column the keys are sorted by, -1 for colstore slot order
+    bool descending;
+    int limit;//most keys the query returns, -1 for no LIMIT
+    struct predicate preds[MAX_COLUMNS_PER_TABLE];
+};
+#define MORSEL_WORDS 64 ///< Bitmap words a QUERY scan handles at a time.
+#define PARALLEL_ROWS_DEFAULT 65536 ///< Records above which a QUERY scan is split.
+
+/**
+ * @brief A QUERY colstore scan shared with the worker pool.
+ *
+ * The scan is cut into morsels of MORSEL_WORDS bitmap words. The
+ * connection thread and idle workers claim morsels until none are left,
+ * gather matching keys in a keylist of their own and merge it into
+ * keys when they leave the job.
+ */
+struct queryjob{
+    struct queryjob *next;//queue of jobs that may have morsels left
+    struct queryprog *prog;
+    struct citytable *table;
+    unsigned int slots;//colstore capacity the scan covers
+    unsigned int nextmorsel;
+    unsigned int nummorsels;
+    int workers;//pool threads inside the job
+    int found;//keys gathered so far, to stop early at limit
+    int limit;
+    struct keylist *keys;
+};
+/**
+ * @brief COUNT, SUM, MIN and MAX of a column over the records matching a query.
+ *
+ * min and max are column values, float keys for a float column; sums
+ * of an int column are kept exact in total, of a float column in sum.
+ */
+struct aggregate{
+    unsigned long count;
+    int min;
+    int max;
+    long long total;
+    double sum;
+};
+#define QUERY_CACHE_DEFAULT 256 ///< QUERY cache entries unless query_cache is set.
+
+/**
+ * @brief A cached page of QUERY cursor results.
+ *
+ * Keyed by table, the predicates sorted so the order they were sent in
+ * doesn't matter, the slot the page starts at and its size; it answers
+ * only while the table is still at version.
+ */
+struct cacheentry{
+    bool used;
+    int table;
+    unsigned long version;
+    int count;
+    struct predicate preds[MAX_COLUMNS_PER_TABLE];
+    unsigned int first;
+    int limit;
+    unsigned int next;//where the page left the cursor
+    int done;
+    struct keylist keys;
 };
 /*End of custom struct*/
 
@@ -213,34 +739,219 @@ char *generate_encrypted_password(const char *passwd, const char *salt);
 
 /*Custom functions*/
 void cleanstring(char *string);
-int decode_value(struct city *target, char *source);
-int encode_value(struct column column[10], char *target, int limit);
+int decode_value(struct schema *schema, char *row, char strvals[][MAX_VALUE_LEN], char *source);
+int encode_value(struct citytable *table, char *row, char *target);
 int decode_line(char *received, char *command, char *tablename, char *keyname, char *value, int *counter);
 int encode_line(char *type, char *status, char *statustwo, char *retline);
-int encode_retval(struct column column[10], char *retval, int limit);
+int encode_retval(struct citytable *table, char *row, char *retval);
+/**
+ * @brief Appends "<name> <value>" of the given columns of row to retval, comma separated.
+ */
+int encode_columns(struct citytable *table, char *row, int *columns, int numcolumns, char *retval);
 bool parser(int input, char type);
-int find_index(char tablelist[MAX_TABLES][MAX_TABLE_LEN], char* name);
+int config_reserve(struct config_params *params, int table, int column);
+void build_tableindex(struct config_params *params);
+int find_index(struct config_params *params, const char* name);
 int columncopy(struct column *source, struct column *dest);
-struct city* create_city(char* new_name, char *codedvalue);
+void slab_init(struct slab *slab);
+void* slab_alloc(struct slab *slab, size_t size);
+void slab_free(struct slab *slab, void *ptr, size_t size);
+void slab_release(struct slab *slab);
+int slab_occupancy(struct slab *slab, char *out, size_t len);
+unsigned int hash_key(const char *key);
+/**
+ * @brief Parses a finite float literal into its float_key().
+ *
+ * @return 0 on success, -1 if text isn't entirely a finite float.
+ */
+int parse_float(const char *text, int *key);
+void init_citytable(struct citytable *table, struct column *columns, int numcolumns);
+void free_citytable(struct citytable *table);
+void build_schema(struct schema *schema, struct column *columns, int numcolumns);
+int schema_column(struct schema *schema, const char *name);
+struct city* create_city(struct citytable *table, char* new_name, char *codedvalue);
 //void insert_city(struct city *head, char* new_name, struct column new_column[MAX_COLUMNS_PER_TABLE]);
-void insert_city(struct city *head, char *new_key, char *value_encoded); 
-int delete_city(struct city **head, char* name);
-struct city* find_city(struct city* head, char* name);
-void print_city(struct city* new_city);
-void print_list(struct city* head);
+struct city* insert_city(struct citytable *table, char *new_key, char *value_encoded);
+int delete_city(struct citytable *table, char* name);
+struct city* find_city(struct citytable *table, char* name);
+/**
+ * @brief Evicts records while a memory cap of the config file is exceeded.
+ *
+ * The table written to is trimmed while it is over its table_memory
+ * cap, then the largest table while the tables together exceed max_memory.
+ * Each victim is the best of EVICTION_SAMPLES random records by the
+ * eviction policy; keep is never evicted and at most EVICTION_PER_SET
+ * records go per call, so the cost is spread over the SETs.
+ *
+ * @return The number of records evicted.
+ */
+int evict_cities(struct config_params *params, struct citytable *tables, int index, struct city *keep);
+
+void strheap_init(struct strheap *heap, struct slab *slab);
+unsigned int strheap_intern(struct strheap *heap, const char *str);
+unsigned int strheap_find(struct strheap *heap, const char *str);
+void strheap_release(struct strheap *heap, unsigned int handle);
+const char* strheap_get(struct strheap *heap, unsigned int handle);
+void strheap_free(struct strheap *heap);
+int ebr_enter(void);
+void ebr_exit(int slot);
+void ebr_retire(void (*reclaim)(void *owner, void *ptr), void *owner, void *ptr);
+void ebr_collect(void);
+void keylist_init(struct keylist *list);
+void keylist_add(struct keylist *list, const char *key);
+void keylist_free(struct keylist *list);
+void intindex_init(struct intindex *index, struct slab *slab);
+void intindex_insert(struct intindex *index, int value, unsigned int slot);
+void intindex_delete(struct intindex *index, int value, unsigned int slot);
+struct intnode* intindex_seek(struct intindex *index, int value);
+void strindex_add(struct strindex *index, unsigned int handle, unsigned int slot);
+void strindex_remove(struct strindex *index, unsigned int handle, unsigned int slot);
+void strindex_free(struct strindex *index);
+void bitmapindex_add(struct bitmapindex *index, unsigned int handle, unsigned int slot);
+void bitmapindex_remove(struct bitmapindex *index, unsigned int handle, unsigned int slot);
+void bitmapindex_free(struct bitmapindex *index);
+void skiplist_init(struct skiplist *list, struct slab *slab);
+int skiplist_insert(struct skiplist *list, struct city *node);
+void skiplist_delete(struct skiplist *list, struct city *node);
+void skiplist_replace(struct skiplist *list, struct city *node, struct city *new_node);
+struct skipnode* skiplist_seek(struct skiplist *list, const char *name);
+int scan_write(struct keylist *keys, struct citytable *table, char mode, char *first, char *last, int limit);
+int scan_argument(char *values, char *mode, char *first, char *last, int *max_keys);
+void print_city(struct citytable *table, struct city* new_city);
+void print_list(struct citytable *table, struct city* head);
 int findtableindex(char tables[MAXLEN][MAX_TABLE_LEN], char name[MAXLEN]);
 void print_column(struct column *column);
-void modify_city(struct city *head, char *value_encoded);
+struct city* modify_city(struct citytable *table, char *name, char *value_encoded);
 int query_argument(struct queryarg *querylist, char *values);
-int query_compare(struct queryarg *querylist, struct city *target, int *querynum);
-int query_write(char keylist[1000][1024], struct queryarg *querylist, struct city *head, int *limit, int *querynum);
+/**
+ * @brief Compiles the predicates parsed by query_argument() for table.
+ *
+ * @return 0 on success, -1 for an unknown column or operator, a
+ * non-integer constant for an int column or a string column compared
+ * with anything but '='.
+ */
+int query_compile(struct queryprog *prog, struct queryarg *querylist, int querynum, struct citytable *table);
+int query_write(struct keylist *keys, struct queryprog *prog, struct citytable *table, int limit);
+/**
+ * @brief Rebuilds the planner statistics of table once enough records changed.
+ *
+ * Called by the writer after each change; STATS_STALE of the records
+ * must have changed since the last build, so the cost per SET stays
+ * small. The new statistics are published whole and the old retired;
+ * the colstore zone bounds are tightened at the same time.
+ */
+void stats_refresh(struct citytable *table);
+/**
+ * @brief Describes the plan of prog and its estimated and actual matches.
+ */
+void query_explain(struct queryprog *prog, struct citytable *table, unsigned long actual, char *plan, int len);
+/**
+ * @brief Adds up to limit keys matching prog from colstore slot *next on.
+ *
+ * *next is left after the last slot looked at, so that the following
+ * call carries on from there. found, if not NULL, gets the record of
+ * each key added, valid until the caller leaves its epoch.
+ * @return 1 once the scan has passed the last slot, 0 otherwise.
+ */
+int cursor_fetch(struct keylist *keys, struct city **found, struct queryprog *prog, struct citytable *table, unsigned int *next, int limit);
+/**
+ * @brief Adds up to limit keys matching prog, in the order of prog->order.
+ *
+ * A bounded heap keeps the first limit matches of a colstore scan, or an
+ * ascending walk of the sorted index of the column stops after limit
+ * matches. With resume, only keys after the one with *value in *slot
+ * count; both are left at the last key added. found, if not NULL, gets
+ * the record of each key added, as in cursor_fetch().
+ * @return 1 once no key is left after the last one added, 0 otherwise,
+ * and -1 if the heap could not be allocated.
+ */
+int query_top(struct keylist *keys, struct city **found, struct queryprog *prog, struct citytable *table,
+	      bool resume, int *value, unsigned int *slot, int limit);
+/**
+ * @brief Moves trailing "ORDER BY <column> [ASC|DESC]" and "LIMIT <n>"
+ * clauses of client predicates to out.
+ *
+ * in is cut before the clauses; out gets %<column>% followed by '<' or
+ * '>', and ~<n>~, as query_argument() reads them.
+ * @return 0 on success, -1 if a clause is malformed.
+ */
+int orderparse(char *in, char *out);
+/**
+ * @brief Splits an AGGR request into its function, column and QUERY predicates.
+ *
+ * The request reads *<function>**<column>* followed by the predicates as
+ * QUERY sends them; column is empty for a COUNT of records.
+ * @return 0 on success, -1 if the request is malformed.
+ */
+int aggregate_argument(char *values, char *function, char *column, char **query);
+/**
+ * @brief Splits a projecting OPEN request into its columns and QUERY predicates.
+ *
+ * An empty column list projects every column of the schema.
+ * @return The number of columns, or -1 for an unknown column.
+ */
+int projection_argument(char *values, struct schema *schema, int *columns, char **query);
+/**
+ * @brief Folds column over the records matching prog into result.
+ *
+ * column is -1 when only the records are counted. The matches are found
+ * as query_write() finds them, in one pass.
+ */
+void query_aggregate(struct aggregate *result, struct queryprog *prog, struct citytable *table, int column);
+/**
+ * @brief Number of records matching prog, at most its LIMIT.
+ *
+ * A lone '=' on a hash or bitmap indexed column is answered from the
+ * index; otherwise the matches are counted off the slot bitmaps without
+ * reading their records.
+ */
+unsigned long query_count(struct queryprog *prog, struct citytable *table);
+/**
+ * @brief Starts the threads QUERY scans of large tables are split over.
+ *
+ * @param threads Threads a scan may use including the caller, 0 for one per CPU.
+ * @param rows Records a table needs before its scans are split.
+ */
+void query_pool_start(int threads, unsigned long rows);
+/**
+ * @brief Allocates a QUERY result cache of entries pages, 0 to disable it.
+ */
+void querycache_init(unsigned long entries);
+/**
+ * @brief Looks up the page of prog starting at *next for table index.
+ *
+ * version is the table's, read before the caller would scan. A hit copies
+ * the keys, moves *next on and counts in table's statistics, as does a miss.
+ * @return The page's cursor_fetch() result, or -1 on a miss.
+ */
+int querycache_get(struct keylist *keys, struct citytable *table, int index, unsigned long version,
+		   struct queryprog *prog, unsigned int *next, int limit);
+/**
+ * @brief Caches a page cursor_fetch() returned from slot first to next.
+ */
+void querycache_put(struct keylist *keys, int index, unsigned long version, struct queryprog *prog,
+		    unsigned int first, unsigned int next, int done, int limit);
 //void parse_client(char *input, char *output);
 void sget(char *s, int arraylength);
 int check_column(struct config_params *param);
 int argparse(char *in, char *out);
 int queryparse(char *in, char *out);
 int decode_queryret(char *ret_buffer, char **keylist);
-void encode_queryret(int num_match, char keylist[1000][1024], char *retstring);
+void encode_queryret(char *command, int num_match, struct keylist *keys, char *retstring);
+/**
+ * @brief Encodes the key, counter and the given columns of each of count rows.
+ *
+ * Rows follow the keys of encode_queryret() as @key@~counter~$value$!,
+ * value as encode_columns() writes it, for as many rows as fit the line.
+ * @return The number of rows encoded.
+ */
+int encode_queryrows(char *command, struct citytable *table, struct city **rows, int count, int *columns, int numcolumns, char *retstring);
+/**
+ * @brief Copies the keys and records of an encode_queryrows() reply.
+ *
+ * @return The number of rows copied.
+ */
+int decode_queryrows(char *ret_buffer, char **keylist, struct storage_record *records);
 void add_equal(char *in);
 /*End of custom functions*/
 